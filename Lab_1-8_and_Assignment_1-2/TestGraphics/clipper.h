@@ -0,0 +1,207 @@
+#pragma once
+
+#include "rasterizer.h"
+#include <algorithm>
+#include <cstdint>
+
+// Pixels the guard band extends past every screen edge. Triangles that stay inside it are not split; the rasterizer
+// scissors them to the screen instead. It is capped so guard-band vertices stay within RASTER_MAX_COORD.
+#define CLIP_GUARD_BAND 2048.0f
+
+// A triangle clipped against the 6 planes has at most 3 + 6 vertices, so at most 7 triangles after fanning
+#define CLIP_MAX_POLYGON 9
+#define CLIP_MAX_TRIANGLES (CLIP_MAX_POLYGON - 2)
+
+// Vertex in homogeneous clip space, before the perspective divide; u and v are the plain texture coordinates
+struct ClipVertex
+{
+    float x, y, z, w;
+    float u, v;
+};
+
+// Per-frame clip counters; every input triangle lands in exactly one of culled, accepted, guardBand or clipped
+struct ClipStats
+{
+    size_t input = 0;
+    size_t culled = 0;    // entirely off screen or outside near/far
+    size_t accepted = 0;  // entirely on screen, passed through untouched
+    size_t guardBand = 0; // crosses a screen edge but stays in the guard band, left to the rasterizer's scissor
+    size_t clipped = 0;   // crosses near, far or the guard band and was split
+    size_t output = 0;    // triangles handed to the rasterizer
+
+    void Add(const ClipStats& o)
+    {
+        input += o.input;
+        culled += o.culled;
+        accepted += o.accepted;
+        guardBand += o.guardBand;
+        clipped += o.clipped;
+        output += o.output;
+    }
+};
+
+// Clip stage between projection and the perspective divide.
+//
+// Clipping happens in homogeneous clip space (0 <= z <= w, as Matrix_MakeProjection produces), where attributes
+// still interpolate linearly, so no vertex behind the camera ever reaches the divide. Only near and far always clip;
+// the four side planes sit at the guard band rather than the screen edges, so the common case of a triangle poking
+// off screen is scissored during rasterization instead of split. The screen planes are still used for rejecting
+// triangles that are entirely off screen.
+class TriangleClipper
+{
+public:
+    void SetViewport(float width, float height)
+    {
+        halfWidth = 0.5f * width;
+        halfHeight = 0.5f * height;
+        const float band = std::min(CLIP_GUARD_BAND, RASTER_MAX_COORD - std::max(width, height) - 1.0f);
+        guardX = 1.0f + band / halfWidth;
+        guardY = 1.0f + band / halfHeight;
+    }
+
+    // Clips one triangle, divides by w and maps it to the screen; writes up to CLIP_MAX_TRIANGLES triangles (3
+    // vertices each) to out and returns how many. New vertices are built in a fixed arena on the stack, so the stage
+    // never allocates and one clipper can be shared by any number of threads.
+    int ClipAndProject(const ClipVertex* tri, RasterVertex* out, ClipStats& stats) const
+    {
+        stats.input++;
+        const unsigned int c0 = Outcode(tri[0]), c1 = Outcode(tri[1]), c2 = Outcode(tri[2]);
+
+        // all three outside the same plane of the screen or near/far
+        if ((c0 & c1 & c2) & (CLIP_NEAR | CLIP_FAR | CLIP_SCREEN_MASK))
+        {
+            stats.culled++;
+            return 0;
+        }
+
+        const unsigned int mustClip = (c0 | c1 | c2) & (CLIP_NEAR | CLIP_FAR | CLIP_GUARD_MASK);
+        if (!mustClip)
+        {
+            if ((c0 | c1 | c2) & CLIP_SCREEN_MASK)
+                stats.guardBand++;
+            else
+                stats.accepted++;
+            for (int k = 0; k < 3; k++)
+                out[k] = Project(tri[k]);
+            stats.output++;
+            return 1;
+        }
+
+        // Sutherland-Hodgman, ping-ponging between the two halves of the arena, against the crossed planes only
+        ClipVertex arena[2][CLIP_MAX_POLYGON];
+        ClipVertex* in = arena[0];
+        ClipVertex* next = arena[1];
+        int count = 3;
+        std::copy(tri, tri + 3, in);
+        for (unsigned int plane = 0; plane < CLIP_PLANE_COUNT && count >= 3; plane++)
+        {
+            if (!(mustClip & (1u << plane)))
+                continue;
+            count = ClipPolygon(in, count, next, plane);
+            std::swap(in, next);
+        }
+        stats.clipped++;
+        if (count < 3)
+            return 0;
+
+        // Divide each polygon vertex once, then fan it into triangles
+        RasterVertex projected[CLIP_MAX_POLYGON];
+        for (int k = 0; k < count; k++)
+            projected[k] = Project(in[k]);
+        for (int k = 1; k + 1 < count; k++)
+        {
+            *out++ = projected[0];
+            *out++ = projected[k];
+            *out++ = projected[k + 1];
+        }
+        stats.output += count - 2;
+        return count - 2;
+    }
+
+private:
+    // Plane bits: near and far, then the guard-band side planes (which clip), then the screen side planes (which
+    // only reject)
+    enum : unsigned int
+    {
+        CLIP_NEAR = 1u << 0,
+        CLIP_FAR = 1u << 1,
+        CLIP_GUARD_LEFT = 1u << 2,
+        CLIP_GUARD_RIGHT = 1u << 3,
+        CLIP_GUARD_TOP = 1u << 4,
+        CLIP_GUARD_BOTTOM = 1u << 5,
+        CLIP_PLANE_COUNT = 6,
+        CLIP_GUARD_MASK = 0x3cu,
+        CLIP_SCREEN_MASK = 0x3c0u, // the same four sides at the screen edges, shifted up by 4
+    };
+
+    float halfWidth = 1.0f, halfHeight = 1.0f;
+    float guardX = 1.0f, guardY = 1.0f;
+
+    // signed distance to plane; the vertex is inside when it is >= 0
+    float Distance(const ClipVertex& v, unsigned int plane) const
+    {
+        switch (plane)
+        {
+        case 0: return v.z;
+        case 1: return v.w - v.z;
+        case 2: return v.x + guardX * v.w;
+        case 3: return guardX * v.w - v.x;
+        case 4: return v.y + guardY * v.w;
+        default: return guardY * v.w - v.y;
+        }
+    }
+
+    unsigned int Outcode(const ClipVertex& v) const
+    {
+        unsigned int code = 0;
+        for (unsigned int plane = 0; plane < CLIP_PLANE_COUNT; plane++)
+            if (!(Distance(v, plane) >= 0.0f))
+                code |= 1u << plane;
+        if (v.x < -v.w) code |= CLIP_GUARD_LEFT << 4;
+        if (v.x > v.w) code |= CLIP_GUARD_RIGHT << 4;
+        if (v.y < -v.w) code |= CLIP_GUARD_TOP << 4;
+        if (v.y > v.w) code |= CLIP_GUARD_BOTTOM << 4;
+        return code;
+    }
+
+    int ClipPolygon(const ClipVertex* in, int count, ClipVertex* out, unsigned int plane) const
+    {
+        int written = 0;
+        const ClipVertex* prev = &in[count - 1];
+        float prevDist = Distance(*prev, plane);
+        for (int k = 0; k < count; k++)
+        {
+            const ClipVertex* cur = &in[k];
+            const float curDist = Distance(*cur, plane);
+            if ((prevDist >= 0.0f) != (curDist >= 0.0f))
+            {
+                // always interpolate from the inside vertex so a shared edge splits at the same point both ways
+                const bool prevInside = prevDist >= 0.0f;
+                const ClipVertex& a = prevInside ? *prev : *cur;
+                const ClipVertex& b = prevInside ? *cur : *prev;
+                const float da = prevInside ? prevDist : curDist;
+                const float db = prevInside ? curDist : prevDist;
+                out[written++] = Lerp(a, b, da / (da - db));
+            }
+            if (curDist >= 0.0f)
+                out[written++] = *cur;
+            prev = cur;
+            prevDist = curDist;
+        }
+        return written;
+    }
+
+    static ClipVertex Lerp(const ClipVertex& a, const ClipVertex& b, float t)
+    {
+        return { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t,
+            a.u + (b.u - a.u) * t, a.v + (b.v - a.v) * t };
+    }
+
+    // Perspective divide. Texture coordinates are divided by w too and 1/w is kept, so u/w, v/w and 1/w interpolate
+    // linearly in screen space; 1/w doubles as the depth value. Then scale into view
+    RasterVertex Project(const ClipVertex& v) const
+    {
+        const float invW = 1.0f / v.w;
+        return { (v.x * invW + 1.0f) * halfWidth, (v.y * invW + 1.0f) * halfHeight, v.u * invW, v.v * invW, invW };
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <raylib.h>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Packs a raylib Color into the framebuffer's pixel layout (R in the lowest byte, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8)
+inline uint32_t PackColor(Color c)
+{
+    return (uint32_t)c.r | ((uint32_t)c.g << 8) | ((uint32_t)c.b << 16) | ((uint32_t)c.a << 24);
+}
+
+// CPU colour and depth buffers the software rasterizer writes straight into.
+// Present() hands the whole colour buffer to the GPU with one UpdateTexture and draws it as one screen-sized quad,
+// instead of a DrawPixel call (and quad) per covered pixel.
+struct Framebuffer
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> color; // row-major, width * height
+    std::vector<float> depth;    // row-major, width * height; 1/w, so larger is nearer and 0 is infinitely far
+    Texture2D target = { 0 };
+
+    // allocates the buffers and the texture they are presented through; needs the window to be open
+    void Create(int w, int h)
+    {
+        width = w;
+        height = h;
+        color.assign((size_t)w * h, 0);
+        depth.assign((size_t)w * h, 0.0f);
+
+        Image blank = GenImageColor(w, h, BLACK);
+        ImageFormat(&blank, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+        target = LoadTextureFromImage(blank);
+        UnloadImage(blank);
+    }
+
+    void Destroy()
+    {
+        UnloadTexture(target);
+        target = { 0 };
+    }
+
+    void Clear(Color c, float z = 0.0f)
+    {
+        std::fill(color.begin(), color.end(), PackColor(c));
+        std::fill(depth.begin(), depth.end(), z);
+    }
+
+    // clears the rectangle [x0, x1) x [y0, y1) only
+    void ClearRect(int x0, int y0, int x1, int y1, Color c, float z = 0.0f)
+    {
+        const uint32_t packed = PackColor(c);
+        for (int y = y0; y < y1; y++)
+        {
+            std::fill(Row(y) + x0, Row(y) + x1, packed);
+            std::fill(DepthRow(y) + x0, DepthRow(y) + x1, z);
+        }
+    }
+
+    uint32_t* Row(int y) { return color.data() + (size_t)y * width; }
+    float* DepthRow(int y) { return depth.data() + (size_t)y * width; }
+
+    // pixels whose depth was written since the last Clear (depth cleared to 0)
+    size_t CoveredPixels() const
+    {
+        return (size_t)std::count_if(depth.begin(), depth.end(), [](float z) { return z > 0.0f; });
+    }
+
+    // uploads the colour buffer and draws it; call between BeginDrawing and EndDrawing
+    void Present()
+    {
+        UpdateTexture(target, color.data());
+        DrawTexture(target, 0, 0, WHITE);
+    }
+};
+
+// Per-frame depth-test counters
+struct RasterStats
+{
+    size_t fragments = 0; // pixels inside triangles that reached the depth test
+    size_t rejected = 0;  // fragments that failed it
+    size_t written = 0;   // fragments that passed and were textured
+    size_t covered = 0;   // distinct pixels covered at the end of the frame
+
+    // fragments per covered pixel; 1.0 means nothing was drawn twice
+    double Overdraw() const { return covered ? (double)fragments / covered : 0.0; }
+};
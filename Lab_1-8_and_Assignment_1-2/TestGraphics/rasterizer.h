@@ -0,0 +1,440 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "soft_texture.h"
+#include <algorithm>
+#include <cmath>
+#include <climits>
+#include <cstdint>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Coverage is tested a block of RASTER_BLOCK_SIZE x RASTER_BLOCK_SIZE pixels at a time, one SIMD register per row
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RASTER_USE_AVX2
+#define RASTER_BLOCK_SIZE 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RASTER_USE_SSE2
+#define RASTER_BLOCK_SIZE 4
+#else
+#define RASTER_BLOCK_SIZE 4
+#endif
+
+// Vertex positions are snapped to 28.4 fixed point
+#define RASTER_SUBPIXEL_BITS 4
+#define RASTER_SUBPIXEL_ONE (1 << RASTER_SUBPIXEL_BITS)
+
+// Triangles with a vertex further than this from the origin (in pixels) are dropped. Within that range an edge
+// function that crosses a block fits in 32 bits, which is what the SIMD coverage test works in. The clip stage
+// (clipper.h) keeps its guard band inside this, so only unclipped input can hit the limit.
+#define RASTER_MAX_COORD 8192.0f
+
+// Screen-space vertex after the perspective divide: u, v and w hold u/w, v/w and 1/w
+struct RasterVertex
+{
+    float x, y;
+    float u, v, w;
+};
+
+// Scissor rectangle [x0, x1) x [y0, y1) in pixels; x0 and y0 must be multiples of RASTER_BLOCK_SIZE
+struct RasterRect
+{
+    int x0, y0, x1, y1;
+};
+
+// Attribute that varies linearly in screen space: value(x, y) = a0 + dx * x + dy * y
+struct RasterPlane
+{
+    float a0, dx, dy;
+
+    float At(float x, float y) const { return a0 + dx * x + dy * y; }
+};
+
+// Plane through the values a[i] at the (snapped) vertex positions x[i], y[i]; invArea2 is 1 / (twice the signed area)
+inline RasterPlane MakeRasterPlane(const float x[3], const float y[3], const float a[3], float invArea2)
+{
+    RasterPlane p;
+    p.dx = ((a[1] - a[0]) * (y[2] - y[0]) - (a[2] - a[0]) * (y[1] - y[0])) * invArea2;
+    p.dy = ((a[2] - a[0]) * (x[1] - x[0]) - (a[1] - a[0]) * (x[2] - x[0])) * invArea2;
+    p.a0 = a[0] - p.dx * x[0] - p.dy * y[0];
+    return p;
+}
+
+// Edge function E(p) = A * p.x + B * p.y + C in fixed point, >= 0 inside the triangle. Pixels exactly on an edge
+// belong to it only if it is a top or left edge (the bias makes E < 0 on the others), so triangles that share an
+// edge never both draw, or both miss, a pixel on it.
+struct RasterEdge
+{
+    int64_t A, B, C;
+
+    void Setup(int64_t ax, int64_t ay, int64_t bx, int64_t by)
+    {
+        A = ay - by;
+        B = bx - ax;
+        C = -(A * ax + B * ay);
+        const bool topLeft = A > 0 || (A == 0 && B > 0);
+        if (!topLeft)
+            C -= 1;
+    }
+
+    // value at the centre of pixel (px, py)
+    int64_t At(int px, int py) const
+    {
+        const int64_t half = RASTER_SUBPIXEL_ONE / 2;
+        return A * ((int64_t)px * RASTER_SUBPIXEL_ONE + half) + B * ((int64_t)py * RASTER_SUBPIXEL_ONE + half) + C;
+    }
+};
+
+// Bit i set where pixel i of a block row is inside the edge; e is the edge at the row's first pixel and laneStep
+// holds A * i (one pixel apart) per lane
+#if defined(RASTER_USE_AVX2)
+inline unsigned int EdgeRowMask(int32_t e, __m256i laneStep)
+{
+    const __m256i values = _mm256_add_epi32(_mm256_set1_epi32(e), laneStep);
+    return ~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(values)) & 0xFFu;
+}
+#elif defined(RASTER_USE_SSE2)
+inline unsigned int EdgeRowMask(int32_t e, __m128i laneStep)
+{
+    const __m128i values = _mm_add_epi32(_mm_set1_epi32(e), laneStep);
+    return ~(unsigned int)_mm_movemask_ps(_mm_castsi128_ps(values)) & 0xFu;
+}
+#endif
+
+// index of the lowest set bit of a non-zero mask
+inline int RasterLowestBit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (int)index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+inline int RasterBitCount(unsigned int mask)
+{
+#if defined(_MSC_VER)
+    return (int)__popcnt(mask);
+#else
+    return __builtin_popcount(mask);
+#endif
+}
+
+// Perspective-correct u and v for the RASTER_BLOCK_SIZE pixel centres starting at (px, py)
+inline void RasterRowUV(float px, float py, const RasterPlane& planeU, const RasterPlane& planeV,
+    const RasterPlane& planeW, float* u, float* v)
+{
+#if defined(RASTER_USE_AVX2)
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 rw = _mm256_div_ps(_mm256_set1_ps(1.0f),
+        _mm256_add_ps(_mm256_set1_ps(planeW.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeW.dx), lane)));
+    const __m256 uv = _mm256_add_ps(_mm256_set1_ps(planeU.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeU.dx), lane));
+    const __m256 vv = _mm256_add_ps(_mm256_set1_ps(planeV.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeV.dx), lane));
+    _mm256_store_ps(u, _mm256_mul_ps(uv, rw));
+    _mm256_store_ps(v, _mm256_mul_ps(vv, rw));
+#elif defined(RASTER_USE_SSE2)
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 rw = _mm_div_ps(_mm_set1_ps(1.0f),
+        _mm_add_ps(_mm_set1_ps(planeW.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeW.dx), lane)));
+    const __m128 uv = _mm_add_ps(_mm_set1_ps(planeU.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeU.dx), lane));
+    const __m128 vv = _mm_add_ps(_mm_set1_ps(planeV.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeV.dx), lane));
+    _mm_store_ps(u, _mm_mul_ps(uv, rw));
+    _mm_store_ps(v, _mm_mul_ps(vv, rw));
+#else
+    for (int i = 0; i < RASTER_BLOCK_SIZE; i++)
+    {
+        const float rw = 1.0f / planeW.At(px + i, py);
+        u[i] = planeU.At(px + i, py) * rw;
+        v[i] = planeV.At(px + i, py) * rw;
+    }
+#endif
+}
+
+// Depth tests and textures the pixels of one block row selected by mask (bit i = pixel x0 + i). 1/w for the row is
+// evaluated and compared against the depth buffer a register at a time; the pixels that pass are then divided and
+// textured together, and only the texel fetch and the stores are done per pixel. Unless the texture is unfiltered,
+// its mip level is picked once per 2x2 quad.
+inline size_t ShadeBlockRow(Framebuffer& fb, const SoftTexture& tex, int x0, int y, int cols, unsigned int mask,
+    const RasterPlane& planeU, const RasterPlane& planeV, const RasterPlane& planeW, RasterStats& stats)
+{
+    const int bs = RASTER_BLOCK_SIZE;
+    const float px = x0 + 0.5f;
+    const float py = y + 0.5f;
+    uint32_t* row = fb.Row(y) + x0;
+    float* depthRow = fb.DepthRow(y) + x0;
+
+    // a partial block at the right edge of the scissor mustn't read past it (or past the buffer)
+    alignas(32) float depth[RASTER_BLOCK_SIZE];
+    const float* depthIn = depthRow;
+    if (cols < bs)
+    {
+        std::copy(depthRow, depthRow + cols, depth);
+        std::fill(depth + cols, depth + bs, 0.0f);
+        depthIn = depth;
+    }
+
+    alignas(32) float w[RASTER_BLOCK_SIZE], u[RASTER_BLOCK_SIZE], v[RASTER_BLOCK_SIZE];
+    unsigned int pass;
+#if defined(RASTER_USE_AVX2)
+    const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+    const __m256 wv = _mm256_add_ps(_mm256_set1_ps(planeW.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeW.dx), lane));
+    pass = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(wv, _mm256_loadu_ps(depthIn), _CMP_GT_OQ)) & mask;
+    if (pass)
+    {
+        const __m256 rw = _mm256_div_ps(_mm256_set1_ps(1.0f), wv);
+        const __m256 uv = _mm256_add_ps(_mm256_set1_ps(planeU.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeU.dx), lane));
+        const __m256 vv = _mm256_add_ps(_mm256_set1_ps(planeV.At(px, py)), _mm256_mul_ps(_mm256_set1_ps(planeV.dx), lane));
+        _mm256_store_ps(w, wv);
+        _mm256_store_ps(u, _mm256_mul_ps(uv, rw));
+        _mm256_store_ps(v, _mm256_mul_ps(vv, rw));
+    }
+#elif defined(RASTER_USE_SSE2)
+    const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+    const __m128 wv = _mm_add_ps(_mm_set1_ps(planeW.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeW.dx), lane));
+    pass = (unsigned int)_mm_movemask_ps(_mm_cmpgt_ps(wv, _mm_loadu_ps(depthIn))) & mask;
+    if (pass)
+    {
+        const __m128 rw = _mm_div_ps(_mm_set1_ps(1.0f), wv);
+        const __m128 uv = _mm_add_ps(_mm_set1_ps(planeU.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeU.dx), lane));
+        const __m128 vv = _mm_add_ps(_mm_set1_ps(planeV.At(px, py)), _mm_mul_ps(_mm_set1_ps(planeV.dx), lane));
+        _mm_store_ps(w, wv);
+        _mm_store_ps(u, _mm_mul_ps(uv, rw));
+        _mm_store_ps(v, _mm_mul_ps(vv, rw));
+    }
+#else
+    pass = 0;
+    for (int i = 0; i < bs; i++)
+    {
+        w[i] = planeW.At(px + i, py);
+        if ((mask & (1u << i)) && w[i] > depthIn[i])
+            pass |= 1u << i;
+    }
+    if (pass)
+        RasterRowUV(px, py, planeU, planeV, planeW, u, v);
+#endif
+
+    size_t written = 0;
+    if (tex.filter == TextureFilter::None)
+    {
+        for (unsigned int m = pass; m; m &= m - 1)
+        {
+            const int i = RasterLowestBit(m);
+            depthRow[i] = w[i];
+            row[i] = tex.Fetch(u[i], v[i]);
+            written++;
+        }
+    }
+    else if (pass)
+    {
+        // Mip level per 2x2 quad (the block starts on an even column), from the differences of u and v across it:
+        // the other row of the quad is evaluated too, and both rows arrive at the same level
+        alignas(32) float otherU[RASTER_BLOCK_SIZE], otherV[RASTER_BLOCK_SIZE];
+        RasterRowUV(px, (float)(y ^ 1) + 0.5f, planeU, planeV, planeW, otherU, otherV);
+        const float* topU = (y & 1) ? otherU : u;
+        const float* topV = (y & 1) ? otherV : v;
+        const float* bottomU = (y & 1) ? u : otherU;
+        const float* bottomV = (y & 1) ? v : otherV;
+        float lod[RASTER_BLOCK_SIZE / 2];
+        for (int q = 0; q < bs / 2; q++)
+        {
+            const int i = q * 2;
+            lod[q] = tex.Lod(topU[i + 1] - topU[i], topV[i + 1] - topV[i], bottomU[i] - topU[i], bottomV[i] - topV[i]);
+        }
+
+        // the filter is picked once per row so the sampler inlines into the pixel loop
+        auto shade = [&](auto sample)
+        {
+            for (unsigned int m = pass; m; m &= m - 1)
+            {
+                const int i = RasterLowestBit(m);
+                depthRow[i] = w[i];
+                row[i] = sample(u[i], v[i], lod[i >> 1]);
+                written++;
+            }
+        };
+        switch (tex.filter)
+        {
+        case TextureFilter::Nearest:
+            shade([&](float su, float sv, float l) { return tex.SampleNearest(su, sv, l); });
+            break;
+        case TextureFilter::Bilinear:
+            shade([&](float su, float sv, float l) { return tex.SampleBilinear(su, sv, l); });
+            break;
+        default:
+            shade([&](float su, float sv, float l) { return tex.SampleTrilinear(su, sv, l); });
+            break;
+        }
+    }
+
+    const size_t fragments = RasterBitCount(mask);
+    stats.fragments += fragments;
+    stats.rejected += fragments - written;
+    return written;
+}
+
+// Half-space rasterizer. Walks the triangle's bounding box in blocks; blocks fully outside an edge are skipped, blocks
+// fully inside all three are filled without per-pixel edge tests, and only blocks the edges cross test coverage, a row
+// at a time in SIMD. Covered pixels are shaded a block row at a time by ShadeBlockRow. u/w, v/w and 1/w are interpolated
+// as screen-space planes and divided per pixel, which makes the texture mapping perspective correct. Depth is tested
+// on 1/w as in DrawTexturedSpan. Nothing outside clip (and the framebuffer) is touched, so threads can rasterize into
+// disjoint rectangles of the same framebuffer. Returns the pixels written.
+inline size_t RasterizeTriangle(const RasterVertex& a, const RasterVertex& b, const RasterVertex& c,
+    const SoftTexture& tex, Framebuffer& fb, RasterStats& stats, RasterRect clip = { 0, 0, INT_MAX, INT_MAX })
+{
+    clip.x1 = std::min(clip.x1, fb.width);
+    clip.y1 = std::min(clip.y1, fb.height);
+
+    const RasterVertex* v[3] = { &a, &b, &c };
+    int64_t X[3], Y[3];
+    for (int i = 0; i < 3; i++)
+    {
+        // written so NaNs fail too
+        if (!(std::fabs(v[i]->x) <= RASTER_MAX_COORD && std::fabs(v[i]->y) <= RASTER_MAX_COORD))
+            return 0;
+        X[i] = (int64_t)std::lrint(v[i]->x * RASTER_SUBPIXEL_ONE);
+        Y[i] = (int64_t)std::lrint(v[i]->y * RASTER_SUBPIXEL_ONE);
+    }
+
+    // Either winding is accepted (culling happened earlier); flip to the one where the edge functions are positive inside
+    int64_t area = (X[1] - X[0]) * (Y[2] - Y[0]) - (Y[1] - Y[0]) * (X[2] - X[0]);
+    if (area == 0)
+        return 0;
+    if (area < 0)
+    {
+        std::swap(v[1], v[2]);
+        std::swap(X[1], X[2]);
+        std::swap(Y[1], Y[2]);
+        area = -area;
+    }
+
+    // Bounding box in pixels, clipped to the scissor rectangle and aligned to blocks
+    const int bs = RASTER_BLOCK_SIZE;
+    int minX = (int)(std::min({ X[0], X[1], X[2] }) >> RASTER_SUBPIXEL_BITS);
+    int minY = (int)(std::min({ Y[0], Y[1], Y[2] }) >> RASTER_SUBPIXEL_BITS);
+    int maxX = (int)(std::max({ X[0], X[1], X[2] }) >> RASTER_SUBPIXEL_BITS);
+    int maxY = (int)(std::max({ Y[0], Y[1], Y[2] }) >> RASTER_SUBPIXEL_BITS);
+    minX = std::max(minX, clip.x0);
+    minY = std::max(minY, clip.y0);
+    maxX = std::min(maxX, clip.x1 - 1);
+    maxY = std::min(maxY, clip.y1 - 1);
+    if (minX > maxX || minY > maxY)
+        return 0;
+    minX &= ~(bs - 1);
+    minY &= ~(bs - 1);
+
+    // Edge i is opposite vertex i
+    RasterEdge edges[3];
+    edges[0].Setup(X[1], Y[1], X[2], Y[2]);
+    edges[1].Setup(X[2], Y[2], X[0], Y[0]);
+    edges[2].Setup(X[0], Y[0], X[1], Y[1]);
+
+    // How far each edge function can move from a block's first pixel to any other pixel of the block
+    int64_t blockMin[3], blockMax[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const int64_t span = (int64_t)(bs - 1) * RASTER_SUBPIXEL_ONE;
+        blockMin[i] = std::min<int64_t>(edges[i].A, 0) * span + std::min<int64_t>(edges[i].B, 0) * span;
+        blockMax[i] = std::max<int64_t>(edges[i].A, 0) * span + std::max<int64_t>(edges[i].B, 0) * span;
+    }
+
+#if defined(RASTER_USE_AVX2)
+    __m256i laneStep[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const int32_t s = (int32_t)(edges[i].A * RASTER_SUBPIXEL_ONE);
+        laneStep[i] = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    }
+#elif defined(RASTER_USE_SSE2)
+    __m128i laneStep[3];
+    for (int i = 0; i < 3; i++)
+    {
+        const int32_t s = (int32_t)(edges[i].A * RASTER_SUBPIXEL_ONE);
+        laneStep[i] = _mm_setr_epi32(0, s, 2 * s, 3 * s);
+    }
+#endif
+
+    // Attribute planes from the snapped positions, so they agree with the coverage test
+    float fx[3], fy[3], fu[3], fv[3], fw[3];
+    for (int i = 0; i < 3; i++)
+    {
+        fx[i] = (float)X[i] / RASTER_SUBPIXEL_ONE;
+        fy[i] = (float)Y[i] / RASTER_SUBPIXEL_ONE;
+        fu[i] = v[i]->u;
+        fv[i] = v[i]->v;
+        fw[i] = v[i]->w;
+    }
+    const float invArea2 = (float)(RASTER_SUBPIXEL_ONE * RASTER_SUBPIXEL_ONE) / (float)area;
+    const RasterPlane planeU = MakeRasterPlane(fx, fy, fu, invArea2);
+    const RasterPlane planeV = MakeRasterPlane(fx, fy, fv, invArea2);
+    const RasterPlane planeW = MakeRasterPlane(fx, fy, fw, invArea2);
+
+    // Edge values at the first pixel of the current block, stepped from block to block
+    int64_t blockRowE[3], blockStepX[3], blockStepY[3];
+    for (int i = 0; i < 3; i++)
+    {
+        blockRowE[i] = edges[i].At(minX, minY);
+        blockStepX[i] = edges[i].A * RASTER_SUBPIXEL_ONE * bs;
+        blockStepY[i] = edges[i].B * RASTER_SUBPIXEL_ONE * bs;
+    }
+
+    size_t pixels = 0;
+    for (int by = minY; by <= maxY; by += bs)
+    {
+        const int rows = std::min(bs, clip.y1 - by);
+        int64_t e[3] = { blockRowE[0] - blockStepX[0], blockRowE[1] - blockStepX[1], blockRowE[2] - blockStepX[2] };
+        for (int i = 0; i < 3; i++)
+            blockRowE[i] += blockStepY[i];
+        for (int bx = minX; bx <= maxX; bx += bs)
+        {
+            // Trivial reject if the block is entirely outside any edge; trivial accept if inside all of them
+            bool reject = false;
+            unsigned int partial = 0; // edges that cross the block
+            for (int i = 0; i < 3; i++)
+            {
+                e[i] += blockStepX[i];
+                if (e[i] + blockMax[i] < 0)
+                    reject = true;
+                else if (e[i] + blockMin[i] < 0)
+                    partial |= 1u << i;
+            }
+            if (reject)
+                continue;
+
+            const int cols = std::min(bs, clip.x1 - bx);
+            const unsigned int colMask = (1u << cols) - 1;
+
+            // Edges crossing the block stay within 32 bits here (see RASTER_MAX_COORD)
+            int32_t rowE[3] = { (int32_t)(partial & 1 ? e[0] : 0), (int32_t)(partial & 2 ? e[1] : 0), (int32_t)(partial & 4 ? e[2] : 0) };
+            for (int r = 0; r < rows; r++)
+            {
+                unsigned int mask = colMask;
+                for (int i = 0; i < 3; i++)
+                {
+                    if (!(partial & (1u << i)))
+                        continue;
+#if defined(RASTER_USE_AVX2) || defined(RASTER_USE_SSE2)
+                    mask &= EdgeRowMask(rowE[i], laneStep[i]);
+#else
+                    unsigned int m = 0;
+                    for (int lane = 0; lane < bs; lane++)
+                        if (rowE[i] + edges[i].A * RASTER_SUBPIXEL_ONE * lane >= 0)
+                            m |= 1u << lane;
+                    mask &= m;
+#endif
+                    rowE[i] += (int32_t)(edges[i].B * RASTER_SUBPIXEL_ONE);
+                }
+                if (!mask)
+                    continue;
+
+                pixels += ShadeBlockRow(fb, tex, bx, by + r, cols, mask, planeU, planeV, planeW, stats);
+            }
+        }
+    }
+    stats.written += pixels;
+    return pixels;
+}
@@ -0,0 +1,238 @@
+#pragma once
+
+#include "framebuffer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// How SoftTexture::Sample filters
+enum class TextureFilter
+{
+    None,      // nearest texel of the full-size, row-major image; no mips (the original path)
+    Nearest,   // nearest texel of the nearest mip level
+    Bilinear,  // 2x2 texels of the nearest mip level
+    Trilinear, // 2x2 texels of the two nearest mip levels, blended by the fractional level
+};
+
+inline const char* TextureFilterName(TextureFilter filter)
+{
+    switch (filter)
+    {
+    case TextureFilter::None: return "none";
+    case TextureFilter::Nearest: return "nearest";
+    case TextureFilter::Bilinear: return "bilinear";
+    default: return "trilinear";
+    }
+}
+
+// Blends two packed colours per channel; t is in [0, 256]. Red/blue and green/alpha go through as pairs of 16-bit
+// lanes, which can't overflow into each other since 255 * 256 < 65536.
+inline uint32_t LerpColor(uint32_t a, uint32_t b, uint32_t t)
+{
+    const uint32_t s = 256 - t;
+    const uint32_t rb = (((a & 0x00ff00ffu) * s + (b & 0x00ff00ffu) * t) >> 8) & 0x00ff00ffu;
+    const uint32_t ga = ((((a >> 8) & 0x00ff00ffu) * s + ((b >> 8) & 0x00ff00ffu) * t)) & 0xff00ff00u;
+    return rb | ga;
+}
+
+// Rounded per-channel average of four packed colours, for building mips
+inline uint32_t AverageColor(uint32_t a, uint32_t b, uint32_t c, uint32_t d)
+{
+    const uint32_t m = 0x00ff00ffu;
+    const uint32_t rb = (((a & m) + (b & m) + (c & m) + (d & m) + 0x00020002u) >> 2) & m;
+    const uint32_t ga = ((((a >> 8) & m) + ((b >> 8) & m) + ((c >> 8) & m) + ((d >> 8) & m) + 0x00020002u) >> 2) & m;
+    return rb | (ga << 8);
+}
+
+// floor() for texel coordinates, without the library call
+inline int TexelFloor(float f)
+{
+    const int i = (int)f;
+    return i - (f < (float)i);
+}
+
+// Cheap log2 for mip selection: the float's exponent plus its mantissa read linearly (off by under 0.09)
+inline float FastLog2(float x)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return (float)bits * (1.0f / (1 << 23)) - 127.0f;
+}
+
+// Texture held as packed RGBA8 texels so the rasterizer reads it directly instead of calling GetImageColor per pixel.
+//
+// Besides the row-major image (kept for Fetch and TextureFilter::None) it keeps a full mip chain. Every level is a
+// power of two, so coordinates wrap with a mask, and is stored in 4x4 texel blocks: a block is 64 contiguous bytes,
+// one cache line, so the texels a 2x2 quad or a bilinear footprint touches are almost always in the same line, in
+// whichever direction the triangle walks across the texture. Images that aren't a power of two are point-resampled
+// up to one before the chain is built.
+struct SoftTexture
+{
+    int width = 0;
+    int height = 0;
+    std::vector<uint32_t> texels; // row-major, width * height
+    TextureFilter filter = TextureFilter::Trilinear;
+
+    struct MipLevel
+    {
+        int width, height;
+        uint32_t maskX, maskY;
+        int blockShift; // log2 of the blocks per row
+        size_t offset;  // of the level's first block in mips
+    };
+    std::vector<MipLevel> levels;
+    std::vector<uint32_t> mips; // every level, 4x4 blocks of 16 texels, blocks row-major
+
+    void Load(Image image)
+    {
+        width = image.width;
+        height = image.height;
+        texels.resize((size_t)width * height);
+        Color* colors = LoadImageColors(image);
+        for (size_t i = 0; i < texels.size(); i++)
+            texels[i] = PackColor(colors[i]);
+        UnloadImageColors(colors);
+        BuildMips();
+    }
+
+    // nearest texel at (u, v) in [0, 1), wrapping (negative coordinates included)
+    uint32_t Fetch(float u, float v) const
+    {
+        int x = (int)(u * width) % width;
+        int y = (int)(v * height) % height;
+        if (x < 0) x += width;
+        if (y < 0) y += height;
+        return texels[(size_t)y * width + x];
+    }
+
+    // Mip level whose texels best match the pixel footprint, from the change of (u, v) across one pixel in x and in y
+    float Lod(float dudx, float dvdx, float dudy, float dvdy) const
+    {
+        const float sx = (float)levels[0].width, sy = (float)levels[0].height;
+        dudx *= sx; dudy *= sx;
+        dvdx *= sy; dvdy *= sy;
+        const float footprint = std::max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+        // log2 of the squared length, halved
+        return footprint > 0.0f ? 0.5f * FastLog2(footprint) : 0.0f;
+    }
+
+    // filtered colour at (u, v), wrapping, with the texture's filter; lod comes from Lod()
+    uint32_t Sample(float u, float v, float lod) const
+    {
+        switch (filter)
+        {
+        case TextureFilter::None: return Fetch(u, v);
+        case TextureFilter::Nearest: return SampleNearest(u, v, lod);
+        case TextureFilter::Bilinear: return SampleBilinear(u, v, lod);
+        default: return SampleTrilinear(u, v, lod);
+        }
+    }
+
+    // The filters one at a time, for callers that pick the filter once for many samples
+    uint32_t SampleNearest(float u, float v, float lod) const { return NearestAt(levels[NearestLevel(lod)], u, v); }
+    uint32_t SampleBilinear(float u, float v, float lod) const { return BilinearAt(levels[NearestLevel(lod)], u, v); }
+
+    uint32_t SampleTrilinear(float u, float v, float lod) const
+    {
+        const int maxLevel = (int)levels.size() - 1;
+        if (!(lod > 0.0f))
+            return BilinearAt(levels[0], u, v);
+        if (lod >= (float)maxLevel)
+            return BilinearAt(levels[maxLevel], u, v);
+        const int level = (int)lod;
+        const uint32_t t = (uint32_t)((lod - (float)level) * 256.0f);
+        return LerpColor(BilinearAt(levels[level], u, v), BilinearAt(levels[level + 1], u, v), t);
+    }
+
+private:
+    int NearestLevel(float lod) const
+    {
+        return std::min((int)levels.size() - 1, std::max(0, (int)(lod + 0.5f)));
+    }
+
+    size_t Address(const MipLevel& level, int x, int y) const
+    {
+        const uint32_t tx = (uint32_t)x & level.maskX;
+        const uint32_t ty = (uint32_t)y & level.maskY;
+        return level.offset + (((size_t)((ty >> 2) << level.blockShift) + (tx >> 2)) << 4) + ((ty & 3) << 2) + (tx & 3);
+    }
+
+    uint32_t NearestAt(const MipLevel& level, float u, float v) const
+    {
+        return mips[Address(level, TexelFloor(u * level.width), TexelFloor(v * level.height))];
+    }
+
+    uint32_t BilinearAt(const MipLevel& level, float u, float v) const
+    {
+        // texel centres sit at half coordinates
+        const float fx = u * level.width - 0.5f;
+        const float fy = v * level.height - 0.5f;
+        const int x = TexelFloor(fx);
+        const int y = TexelFloor(fy);
+        const uint32_t tx = (uint32_t)((fx - (float)x) * 256.0f);
+        const uint32_t ty = (uint32_t)((fy - (float)y) * 256.0f);
+        const uint32_t top = LerpColor(mips[Address(level, x, y)], mips[Address(level, x + 1, y)], tx);
+        const uint32_t bottom = LerpColor(mips[Address(level, x, y + 1)], mips[Address(level, x + 1, y + 1)], tx);
+        return LerpColor(top, bottom, ty);
+    }
+
+    static int NextPowerOfTwo(int n)
+    {
+        int p = 1;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    static int Log2(int n)
+    {
+        int shift = 0;
+        while ((1 << shift) < n)
+            shift++;
+        return shift;
+    }
+
+    void BuildMips()
+    {
+        levels.clear();
+        mips.clear();
+        if (width <= 0 || height <= 0)
+            return;
+
+        int w = NextPowerOfTwo(width);
+        int h = NextPowerOfTwo(height);
+        std::vector<uint32_t> image((size_t)w * h);
+        for (int y = 0; y < h; y++)
+            for (int x = 0; x < w; x++)
+                image[(size_t)y * w + x] = texels[(size_t)(y * height / h) * width + (x * width / w)];
+
+        for (;;)
+        {
+            const int blocksX = std::max(1, w / 4), blocksY = std::max(1, h / 4);
+            MipLevel level = { w, h, (uint32_t)w - 1, (uint32_t)h - 1, Log2(blocksX), mips.size() };
+            levels.push_back(level);
+            mips.resize(mips.size() + (size_t)blocksX * blocksY * 16);
+            for (int y = 0; y < h; y++)
+                for (int x = 0; x < w; x++)
+                    mips[Address(level, x, y)] = image[(size_t)y * w + x];
+
+            if (w == 1 && h == 1)
+                break;
+
+            // 2x2 box filter; a side that is already 1 texel stays 1
+            const int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+            const int dx = w > 1 ? 1 : 0, dy = h > 1 ? w : 0;
+            std::vector<uint32_t> next((size_t)nw * nh);
+            for (int y = 0; y < nh; y++)
+                for (int x = 0; x < nw; x++)
+                {
+                    const size_t i = (size_t)(y * (h / nh)) * w + x * (w / nw);
+                    next[(size_t)y * nw + x] = AverageColor(image[i], image[i + dx], image[i + dy], image[i + dy + dx]);
+                }
+            image.swap(next);
+            w = nw;
+            h = nh;
+        }
+    }
+};
@@ -6,6 +6,15 @@
 #include <string>
 #include <fstream>
 #include <strstream>
+#include <random>
+#include <chrono>
+
+#include "framebuffer.h"
+#include "rasterizer.h"
+#include "tiled_renderer.h"
+#include "clipper.h"
+#include "vertex_stage.h"
+#include "../../post-mid/Lab9/obj_loader.h"
 
 using namespace std;
 
@@ -34,6 +43,8 @@ struct triangle {
 // Mesh structure
 struct mesh {
     vector<triangle> tris;
+
+    // The original stream-based loader; meshes are now loaded with loadObj, this is kept for the OBJ benchmark
     bool LoadFromObjectFile(string sFilename, bool bHasTexture = false)
     {
         ifstream f(sFilename);
@@ -124,9 +135,10 @@ struct camera {
 };
 
 // Global variables
-mesh meshCube;
 Texture2D texBrick;
 Image img;
+SoftTexture texSoft;
+Framebuffer framebuffer;
 camera cam;
 float fNear = 0.1f;
 float fFar = 1000.0f;
@@ -134,6 +146,50 @@ float fFov = 90.0f;
 float fAspectRatio;
 float fFovRad;
 
+// Fill-rate benchmark results (press B)
+double benchMpixPerSec = 0.0;
+double benchDrawPixelMpixPerSec = 0.0;
+
+// Depth-test counters for the current frame, and whether to sort front to back first (press F)
+RasterStats rasterStats;
+bool bSortFrontToBack = true;
+
+// Rasterizer benchmark results (press R): edge-function vs scanline
+struct RasterBenchmark
+{
+    double edgeMtris = 0.0, edgeMpix = 0.0;
+    double scanlineMtris = 0.0, scanlineMpix = 0.0;
+} rasterBench;
+
+// Vertex stage benchmark results (press V): batched WVP transform vs three Matrix_MultiplyVector calls per vertex
+struct VertexBenchmark
+{
+    double batchedMverts = 0.0;
+    double perVertexMverts = 0.0;
+} vertexBench;
+
+// Texture benchmark results (press X), in Mpix/s per filter, for a minified and a magnified full-screen quad
+struct TextureBenchmark
+{
+    double minifiedMpix[4] = { 0.0 };
+    double magnifiedMpix[4] = { 0.0 };
+} textureBench;
+
+// Tiled renderer used for the frame, and whether to draw the wireframe on top (press T)
+TiledRenderer renderer;
+bool bWireframe = true;
+
+// The mesh as an indexed SoA vertex stream, and its vertices in clip space for the current frame
+IndexedMesh meshIndexed;
+ClipSpaceBuffer clipVerts;
+
+// Clip stage, and its counters for the current frame, kept per front-end thread and summed after rendering
+TriangleClipper clipper;
+ClipStats clipStats;
+vector<ClipStats> clipThreadStats;
+
+static_assert(CLIP_MAX_TRIANGLES <= TILE_MAX_OUTPUT_TRIANGLES, "the tiled renderer must take every clipped triangle");
+
 // Function declarations
 void MultiplyMatrixVector(vec3d& i, vec3d& o, mat4x4& m);
 mat4x4 Matrix_MakeIdentity();
@@ -154,13 +210,28 @@ float Vector_DotProduct(vec3d& v1, vec3d& v2);
 float Vector_Length(vec3d& v);
 vec3d Vector_Normalise(vec3d& v);
 vec3d Vector_CrossProduct(vec3d& v1, vec3d& v2);
-void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
+size_t DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
     int x2, int y2, float u2, float v2, float w2,
     int x3, int y3, float u3, float v3, float w3,
-    Image tex);
-
-int main()
+    const SoftTexture& tex, Framebuffer& fb);
+void RunFillRateBenchmark(Framebuffer& fb, const SoftTexture& tex);
+void RunRasterBenchmark(Framebuffer& fb, const SoftTexture& tex);
+int ProjectTriangle(size_t t, RasterVertex* out, ClipStats& stats);
+void RunVertexBenchmark();
+void RunTextureBenchmark(Framebuffer& fb);
+void RunObjBenchmark(const char* path);
+void ToIndexedMesh(ObjMesh& obj, IndexedMesh& out);
+
+// Usage: test [mesh.obj]; without arguments the textured cube.obj is drawn. test --bench-obj mesh.obj times the OBJ
+// loaders on mesh.obj and exits
+int main(int argc, char** argv)
 {
+    if (argc > 2 && string(argv[1]) == "--bench-obj")
+    {
+        RunObjBenchmark(argv[2]);
+        return 0;
+    }
+
     // Initialize window
     const int screenWidth = 800;
     const int screenHeight = 600;
@@ -177,9 +248,24 @@ int main()
     // Load texture
     texBrick = LoadTexture("brmarble.jpg");
     img = LoadImageFromTexture(texBrick);
+    texSoft.Load(img);
+
+    // CPU framebuffer the rasterizer draws into
+    framebuffer.Create(screenWidth, screenHeight);
 
-    // Load cube mesh
-    meshCube.LoadFromObjectFile("cube.obj", true);
+    // Load the mesh; the wireframe is only drawn by default for small ones
+    const char* meshPath = argc > 1 ? argv[1] : "cube.obj";
+    ObjMesh obj;
+    ObjLoadStats objStats;
+    if (loadObj(meshPath, obj, ObjLoadOptions(), &objStats))
+        TraceLog(LOG_INFO, "MESH: %s: %zu triangles, %zu vertices, %.0f MB/s on %u threads", meshPath, obj.triangleCount(),
+            obj.vertexCount(), objStats.megabytesPerSecond(), objStats.threads);
+    else
+        TraceLog(LOG_WARNING, "MESH: %s: %s", meshPath, obj.error.c_str());
+    ToIndexedMesh(obj, meshIndexed);
+    bWireframe = meshIndexed.TriangleCount() <= 4096;
+
+    clipper.SetViewport((float)screenWidth, (float)screenHeight);
 
     // Calculate aspect ratio and FOV
     fAspectRatio = (float)screenHeight / (float)screenWidth;
@@ -204,6 +290,14 @@ int main()
         if (IsKeyDown(KEY_W)) cam.pos = Vector_Add(cam.pos, vForward);
         if (IsKeyDown(KEY_S)) cam.pos = Vector_Sub(cam.pos, vForward);
 
+        if (IsKeyPressed(KEY_B)) RunFillRateBenchmark(framebuffer, texSoft);
+        if (IsKeyPressed(KEY_F)) bSortFrontToBack = !bSortFrontToBack;
+        if (IsKeyPressed(KEY_R)) RunRasterBenchmark(framebuffer, texSoft);
+        if (IsKeyPressed(KEY_T)) bWireframe = !bWireframe;
+        if (IsKeyPressed(KEY_V)) RunVertexBenchmark();
+        if (IsKeyPressed(KEY_X)) RunTextureBenchmark(framebuffer);
+        if (IsKeyPressed(KEY_M)) texSoft.filter = (TextureFilter)(((int)texSoft.filter + 1) % 4);
+
         if (IsKeyDown(KEY_A))
         {
             vec3d vLeft = { -vForward.z, 0, vForward.x };
@@ -238,121 +332,104 @@ int main()
         // Create projection matrix
         mat4x4 matProj = Matrix_MakeProjection();
 
-        // Store triangles for sorting
-        vector<triangle> vecTrianglesToRaster;
+        // The mesh is rotated and then offset into the scene; concatenate that with the view and projection so every
+        // unique vertex is transformed once, by one matrix, into the post-transform cache
+        mat4x4 matTrans = Matrix_MakeTranslation(0.0f, 0.0f, 3.0f);
+        mat4x4 matWorld = Matrix_MultiplyMatrix(matRot, matTrans);
+        mat4x4 matWorldView = Matrix_MultiplyMatrix(matWorld, matView);
+        mat4x4 matWorldViewProj = Matrix_MultiplyMatrix(matWorldView, matProj);
+        TransformVertices(matWorldViewProj.m, meshIndexed.verts, clipVerts);
 
-        // Draw triangles
+        clipThreadStats.assign(renderer.ThreadCount(), ClipStats());
+        auto project = [](size_t i, RasterVertex* out, unsigned int thread)
+            {
+                return ProjectTriangle(i, out, clipThreadStats[thread]);
+            };
+
+        // Bin the triangles into screen tiles, then rasterize the tiles in parallel. The depth buffer resolves
+        // visibility, so no back-to-front sort is needed; sorting each tile front to back is optional and lets the
+        // early depth test reject hidden pixels before they are textured
+        renderer.sortFrontToBack = bSortFrontToBack;
+        renderer.Render(framebuffer, texSoft, meshIndexed.TriangleCount(), project, BLACK);
+        rasterStats = renderer.stats.raster;
+        clipStats = ClipStats();
+        for (const ClipStats& threadStats : clipThreadStats)
+            clipStats.Add(threadStats);
+        rasterStats.covered = framebuffer.CoveredPixels();
+
+        // Present the framebuffer, then draw the wireframe on top of it
         BeginDrawing();
         ClearBackground(BLACK);
+        framebuffer.Present();
 
-        // Process each triangle in the mesh
-        for (auto tri : meshCube.tris)
-        {
-            triangle triTransformed, triViewed, triProjected;
-
-            // Transform triangle by rotation and translation
-            triTransformed.p[0] = Matrix_MultiplyVector(matRot, tri.p[0]);
-            triTransformed.p[1] = Matrix_MultiplyVector(matRot, tri.p[1]);
-            triTransformed.p[2] = Matrix_MultiplyVector(matRot, tri.p[2]);
-
-            // Offset into the scene
-            triTransformed.p[0].z += 3.0f;
-            triTransformed.p[1].z += 3.0f;
-            triTransformed.p[2].z += 3.0f;
-
-            // Copy texture coordinates
-            triTransformed.t[0] = tri.t[0];
-            triTransformed.t[1] = tri.t[1];
-            triTransformed.t[2] = tri.t[2];
-
-            // Calculate triangle normal
-            vec3d normal, line1, line2;
-            line1 = Vector_Sub(triTransformed.p[1], triTransformed.p[0]);
-            line2 = Vector_Sub(triTransformed.p[2], triTransformed.p[0]);
-            normal = Vector_CrossProduct(line1, line2);
-            normal = Vector_Normalise(normal);
-
-            // Cull triangles that are facing away from the camera
-            vec3d vCameraRay = Vector_Sub(triTransformed.p[0], cam.pos);
-            if (Vector_DotProduct(normal, vCameraRay) < 0.0f)
-            {
-                // Convert world space to view space
-                triViewed.p[0] = Matrix_MultiplyVector(matView, triTransformed.p[0]);
-                triViewed.p[1] = Matrix_MultiplyVector(matView, triTransformed.p[1]);
-                triViewed.p[2] = Matrix_MultiplyVector(matView, triTransformed.p[2]);
-
-                // Copy texture coordinates
-                triViewed.t[0] = triTransformed.t[0];
-                triViewed.t[1] = triTransformed.t[1];
-                triViewed.t[2] = triTransformed.t[2];
-
-                // Project triangles from 3D to 2D
-                triProjected.p[0] = Matrix_MultiplyVector(matProj, triViewed.p[0]);
-                triProjected.p[1] = Matrix_MultiplyVector(matProj, triViewed.p[1]);
-                triProjected.p[2] = Matrix_MultiplyVector(matProj, triViewed.p[2]);
-
-                // Copy texture coordinates
-                triProjected.t[0] = triViewed.t[0];
-                triProjected.t[1] = triViewed.t[1];
-                triProjected.t[2] = triViewed.t[2];
-
-                // Scale into view
-                triProjected.p[0].x += 1.0f; triProjected.p[0].y += 1.0f;
-                triProjected.p[1].x += 1.0f; triProjected.p[1].y += 1.0f;
-                triProjected.p[2].x += 1.0f; triProjected.p[2].y += 1.0f;
-
-                triProjected.p[0].x *= 0.5f * (float)screenWidth;
-                triProjected.p[0].y *= 0.5f * (float)screenHeight;
-                triProjected.p[1].x *= 0.5f * (float)screenWidth;
-                triProjected.p[1].y *= 0.5f * (float)screenHeight;
-                triProjected.p[2].x *= 0.5f * (float)screenWidth;
-                triProjected.p[2].y *= 0.5f * (float)screenHeight;
-
-                // Store triangle for sorting
-                vecTrianglesToRaster.push_back(triProjected);
-            }
-        }
-
-        // Sort triangles from back to front
-        sort(vecTrianglesToRaster.begin(), vecTrianglesToRaster.end(), [](triangle& t1, triangle& t2)
-            {
-                float z1 = (t1.p[0].z + t1.p[1].z + t1.p[2].z) / 3.0f;
-                float z2 = (t2.p[0].z + t2.p[1].z + t2.p[2].z) / 3.0f;
-                return z1 > z2;
-            });
-
-        // Draw the triangles
-        for (auto& triToRaster : vecTrianglesToRaster)
-        {
-            // Draw textured triangle
-            DrawTexturedTriangle(
-                triToRaster.p[0].x, triToRaster.p[0].y, triToRaster.t[0].u, triToRaster.t[0].v, triToRaster.p[0].w,
-                triToRaster.p[1].x, triToRaster.p[1].y, triToRaster.t[1].u, triToRaster.t[1].v, triToRaster.p[1].w,
-                triToRaster.p[2].x, triToRaster.p[2].y, triToRaster.t[2].u, triToRaster.t[2].v, triToRaster.p[2].w,
-                img
-            );
-
-            // Draw triangle wireframe
-            DrawTriangleLines(
-                { triToRaster.p[0].x, triToRaster.p[0].y },
-                { triToRaster.p[1].x, triToRaster.p[1].y },
-                { triToRaster.p[2].x, triToRaster.p[2].y },
-                WHITE
-            );
-        }
+        if (bWireframe)
+            renderer.ForEachTriangle([](const RasterVertex& a, const RasterVertex& b, const RasterVertex& c)
+                {
+                    DrawTriangleLines({ a.x, a.y }, { b.x, b.y }, { c.x, c.y }, WHITE);
+                });
 
         // Draw FPS
         DrawFPS(10, 10);
+        if (benchMpixPerSec > 0.0)
+            DrawText(TextFormat("Fill rate: %.1f Mpix/s (DrawPixel: %.2f Mpix/s)", benchMpixPerSec, benchDrawPixelMpixPerSec), 10, 35, 20, GREEN);
+        DrawText(TextFormat("Overdraw: %.2f  depth rejected: %zu of %zu  %s", rasterStats.Overdraw(), rasterStats.rejected,
+            rasterStats.fragments, bSortFrontToBack ? "(front to back)" : "(unsorted)"), 10, 60, 20, GREEN);
+        DrawText(TextFormat("Filter: %s", TextureFilterName(texSoft.filter)), 500, 10, 20, GREEN);
+        if (rasterBench.edgeMtris > 0.0)
+            DrawText(TextFormat("Edge: %.2f Mtris/s %.1f Mpix/s  Scanline: %.2f Mtris/s %.1f Mpix/s", rasterBench.edgeMtris,
+                rasterBench.edgeMpix, rasterBench.scanlineMtris, rasterBench.scanlineMpix), 10, 85, 20, GREEN);
+        DrawText(TextFormat("Tiles: %d threads  %zu of %zu tris binned (%zu tile entries)  front %.2f ms  back %.2f ms",
+            renderer.ThreadCount(), renderer.stats.binnedTriangles, renderer.stats.inputTriangles, renderer.stats.tileEntries,
+            renderer.stats.frontEndMs, renderer.stats.backEndMs), 10, 110, 20, GREEN);
+        DrawText(TextFormat("Clip: %zu in  %zu culled  %zu on screen  %zu guard band  %zu clipped  -> %zu out",
+            clipStats.input, clipStats.culled, clipStats.accepted, clipStats.guardBand, clipStats.clipped, clipStats.output),
+            10, 135, 20, GREEN);
+        if (vertexBench.batchedMverts > 0.0)
+            DrawText(TextFormat("Vertex: %.0f Mverts/s batched (%d wide)  %.0f Mverts/s per vertex  (%zu unique of %zu corners)",
+                vertexBench.batchedMverts, VERTEX_SIMD_WIDTH, vertexBench.perVertexMverts, meshIndexed.verts.Size(),
+                meshIndexed.indices.size()), 10, 160, 20, GREEN);
+        if (textureBench.minifiedMpix[0] > 0.0)
+            DrawText(TextFormat("Texture Mpix/s min/mag: none %.0f/%.0f  nearest %.0f/%.0f  bilinear %.0f/%.0f  trilinear %.0f/%.0f",
+                textureBench.minifiedMpix[0], textureBench.magnifiedMpix[0], textureBench.minifiedMpix[1], textureBench.magnifiedMpix[1],
+                textureBench.minifiedMpix[2], textureBench.magnifiedMpix[2], textureBench.minifiedMpix[3], textureBench.magnifiedMpix[3]),
+                10, 185, 20, GREEN);
         EndDrawing();
     }
 
     // Cleanup
+    framebuffer.Destroy();
+    UnloadImage(img);
     UnloadTexture(texBrick);
     CloseWindow();
 
     return 0;
 }
 
+// Culls, clips and projects triangle t of meshIndexed, reading its corners from the post-transform cache. Writes up
+// to CLIP_MAX_TRIANGLES screen-space triangles to out and returns how many; 0 if the triangle faces away from the
+// camera or is clipped away. Only reads shared state, so the tiled renderer calls it from several threads at once,
+// each with its own stats
+int ProjectTriangle(size_t t, RasterVertex* out, ClipStats& stats)
+{
+    const uint32_t* corner = &meshIndexed.indices[t * 3];
+    ClipVertex clip[3];
+    for (int k = 0; k < 3; k++)
+    {
+        const uint32_t i = corner[k];
+        clip[k] = { clipVerts.x[i], clipVerts.y[i], clipVerts.z[i], clipVerts.w[i], meshIndexed.verts.u[i], meshIndexed.verts.v[i] };
+    }
+
+    // Cull triangles that are facing away from the camera. In clip space that is the sign of det[x y w] of the three
+    // corners, which is the same test as the normal against the camera ray but still holds for corners behind the camera
+    const float det = clip[0].x * (clip[1].y * clip[2].w - clip[1].w * clip[2].y)
+        - clip[0].y * (clip[1].x * clip[2].w - clip[1].w * clip[2].x)
+        + clip[0].w * (clip[1].x * clip[2].y - clip[1].y * clip[2].x);
+    if (det >= 0.0f)
+        return 0;
+
+    return clipper.ClipAndProject(clip, out, stats);
+}
+
 // Matrix multiplication with vector
 vec3d Matrix_MultiplyVector(mat4x4& m, vec3d& i)
 {
@@ -542,11 +619,49 @@ vec3d Vector_CrossProduct(vec3d& v1, vec3d& v2)
     return v;
 }
 
-// Draw textured triangle
-void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
+// Draw one textured span of row y from ax to bx straight into the framebuffer, clipped to the screen
+static size_t DrawTexturedSpan(Framebuffer& fb, const SoftTexture& tex, int y, int ax, int bx,
+    float tex_su, float tex_sv, float tex_sw, float tex_eu, float tex_ev, float tex_ew)
+{
+    if (y < 0 || y >= fb.height || bx <= ax)
+        return 0;
+
+    float tstep = 1.0f / ((float)(bx - ax));
+    int start = max(ax, 0);
+    int end = min(bx, fb.width);
+    float t = (start - ax) * tstep;
+
+    uint32_t* row = fb.Row(y);
+    float* depthRow = fb.DepthRow(y);
+    size_t pixels = 0;
+    for (int j = start; j < end; j++)
+    {
+        float tw = (1.0f - t) * tex_sw + t * tex_ew;
+
+        // Early depth test on 1/w (larger is nearer, cleared to 0), before the texture is touched
+        if (tw > depthRow[j])
+        {
+            float tu = (1.0f - t) * tex_su + t * tex_eu;
+            float tv = (1.0f - t) * tex_sv + t * tex_ev;
+            depthRow[j] = tw;
+            row[j] = tex.Fetch(tu / tw, tv / tw);
+            pixels++;
+        }
+        else
+            rasterStats.rejected++;
+
+        t += tstep;
+    }
+    rasterStats.fragments += end - start;
+    rasterStats.written += pixels;
+    return pixels;
+}
+
+// Draw textured triangle into the framebuffer; returns the number of pixels written
+size_t DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
     int x2, int y2, float u2, float v2, float w2,
     int x3, int y3, float u3, float v3, float w3,
-    Image tex)
+    const SoftTexture& tex, Framebuffer& fb)
 {
     // Sort the points in order of ascending y
     if (y2 < y1) {
@@ -586,10 +701,12 @@ void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
     if (dy2) dv2_step = dv2 / (float)abs(dy2);
     if (dy2) dw2_step = dw2 / (float)abs(dy2);
 
+    size_t pixels = 0;
+
     // Draw the first part of the triangle (top to middle)
     if (dy1)
     {
-        for (int i = y1; i <= y2; i++)
+        for (int i = max(y1, 0); i <= min(y2, fb.height - 1); i++)
         {
             int ax = x1 + (i - y1) * dax_step;
             int bx = x1 + (i - y1) * dbx_step;
@@ -610,23 +727,7 @@ void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
                 swap(tex_sw, tex_ew);
             }
 
-            float tstep = 1.0f / ((float)(bx - ax));
-            float t = 0.0f;
-
-            for (int j = ax; j < bx; j++)
-            {
-                float tu = (1.0f - t) * tex_su + t * tex_eu;
-                float tv = (1.0f - t) * tex_sv + t * tex_ev;
-                float tw = (1.0f - t) * tex_sw + t * tex_ew;
-
-                if (tw > 0)
-                {
-                    Color color = GetImageColor(tex, (int)((tu / tw) * tex.width) % tex.width, (int)((tv / tw) * tex.height) % tex.height);
-                    DrawPixel(j, i, color);
-                }
-
-                t += tstep;
-            }
+            pixels += DrawTexturedSpan(fb, tex, i, ax, bx, tex_su, tex_sv, tex_sw, tex_eu, tex_ev, tex_ew);
         }
     }
 
@@ -648,7 +749,7 @@ void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
     // Draw the second part of the triangle (middle to bottom)
     if (dy1)
     {
-        for (int i = y2; i <= y3; i++)
+        for (int i = max(y2, 0); i <= min(y3, fb.height - 1); i++)
         {
             int ax = x2 + (i - y2) * dax_step;
             int bx = x1 + (i - y1) * dbx_step;
@@ -669,23 +770,276 @@ void DrawTexturedTriangle(int x1, int y1, float u1, float v1, float w1,
                 swap(tex_sw, tex_ew);
             }
 
-            float tstep = 1.0f / ((float)(bx - ax));
-            float t = 0.0f;
+            pixels += DrawTexturedSpan(fb, tex, i, ax, bx, tex_su, tex_sv, tex_sw, tex_eu, tex_ev, tex_ew);
+        }
+    }
 
-            for (int j = ax; j < bx; j++)
-            {
-                float tu = (1.0f - t) * tex_su + t * tex_eu;
-                float tv = (1.0f - t) * tex_sv + t * tex_ev;
-                float tw = (1.0f - t) * tex_sw + t * tex_ew;
+    return pixels;
+}
 
-                if (tw > 0)
-                {
-                    Color color = GetImageColor(tex, (int)((tu / tw) * tex.width) % tex.width, (int)((tv / tw) * tex.height) % tex.height);
-                    DrawPixel(j, i, color);
-                }
+// Fill-rate benchmark: rasterizes depth-tested full-screen textured quads into the framebuffer for about half a second,
+// then times the old path (one DrawPixel per pixel) on a smaller area for comparison
+void RunFillRateBenchmark(Framebuffer& fb, const SoftTexture& tex)
+{
+    const int w = fb.width;
+    const int h = fb.height;
+
+    size_t pixels = 0;
+    double start = GetTime();
+    double elapsed = 0.0;
+    while (elapsed < 0.5)
+    {
+        // both quads sit at the same depth, so reset the depth buffer each pass or they'd be rejected
+        fill(fb.depth.begin(), fb.depth.end(), 0.0f);
+        pixels += DrawTexturedTriangle(0, 0, 0.0f, 0.0f, 1.0f, w, 0, 4.0f, 0.0f, 1.0f, 0, h, 0.0f, 4.0f, 1.0f, tex, fb);
+        pixels += DrawTexturedTriangle(w, 0, 4.0f, 0.0f, 1.0f, w, h, 4.0f, 4.0f, 1.0f, 0, h, 0.0f, 4.0f, 1.0f, tex, fb);
+        elapsed = GetTime() - start;
+    }
+    benchMpixPerSec = pixels / elapsed / 1e6;
+
+    // DrawPixel is measured over a 256x256 block, submitted like the old rasterizer did
+    const int block = 256;
+    BeginDrawing();
+    start = GetTime();
+    for (int y = 0; y < block; y++)
+        for (int x = 0; x < block; x++)
+            DrawPixel(x, y, WHITE);
+    EndDrawing();
+    elapsed = GetTime() - start;
+    benchDrawPixelMpixPerSec = (double)block * block / elapsed / 1e6;
+
+    TraceLog(LOG_INFO, "FILLRATE: framebuffer %.1f Mpix/s, DrawPixel %.2f Mpix/s", benchMpixPerSec, benchDrawPixelMpixPerSec);
+}
 
-                t += tstep;
+// Rasterizer benchmark: the same random triangles through RasterizeTriangle and the scanline DrawTexturedTriangle,
+// for about a quarter of a second each. Triangle rate is measured on small triangles (up to 16 pixels across), where
+// setup dominates, and pixel rate (depth-tested fragments) on large ones (up to 128 pixels across).
+void RunRasterBenchmark(Framebuffer& fb, const SoftTexture& tex)
+{
+    const int count = 20000;
+    vector<RasterVertex> verts(count * 3);
+
+    auto generate = [&](float size)
+    {
+        mt19937 rng(1234);
+        uniform_real_distribution<float> posX(0.0f, (float)fb.width - size), posY(0.0f, (float)fb.height - size);
+        uniform_real_distribution<float> offset(0.0f, size), depth(0.5f, 1.0f);
+        for (int i = 0; i < count; i++)
+        {
+            float x = posX(rng), y = posY(rng), w = depth(rng);
+            verts[i * 3 + 0] = { x, y, 0.0f, 0.0f, w };
+            verts[i * 3 + 1] = { x + offset(rng), y + offset(rng), w, 0.0f, w };
+            verts[i * 3 + 2] = { x + offset(rng), y + offset(rng), 0.0f, w, w };
+        }
+    };
+
+    // returns triangles and fragments per second, in millions
+    auto measure = [&](bool edge, double& mtris, double& mpix)
+    {
+        RasterStats stats;
+        rasterStats = RasterStats();
+        size_t triangles = 0;
+        double start = GetTime();
+        double elapsed = 0.0;
+        while (elapsed < 0.25)
+        {
+            fill(fb.depth.begin(), fb.depth.end(), 0.0f);
+            for (int i = 0; i < count; i++)
+            {
+                const RasterVertex* v = &verts[i * 3];
+                if (edge)
+                    RasterizeTriangle(v[0], v[1], v[2], tex, fb, stats);
+                else
+                    DrawTexturedTriangle((int)v[0].x, (int)v[0].y, v[0].u, v[0].v, v[0].w,
+                        (int)v[1].x, (int)v[1].y, v[1].u, v[1].v, v[1].w,
+                        (int)v[2].x, (int)v[2].y, v[2].u, v[2].v, v[2].w, tex, fb);
             }
+            triangles += count;
+            elapsed = GetTime() - start;
         }
+        size_t fragments = edge ? stats.fragments : rasterStats.fragments;
+        mtris = triangles / elapsed / 1e6;
+        mpix = fragments / elapsed / 1e6;
+    };
+
+    double unused;
+    generate(16.0f);
+    measure(true, rasterBench.edgeMtris, unused);
+    measure(false, rasterBench.scanlineMtris, unused);
+    generate(128.0f);
+    measure(true, unused, rasterBench.edgeMpix);
+    measure(false, unused, rasterBench.scanlineMpix);
+
+    TraceLog(LOG_INFO, "RASTER: edge function %.2f Mtris/s %.1f Mpix/s, scanline %.2f Mtris/s %.1f Mpix/s (%dx%d blocks)",
+        rasterBench.edgeMtris, rasterBench.edgeMpix, rasterBench.scanlineMtris, rasterBench.scanlineMpix,
+        RASTER_BLOCK_SIZE, RASTER_BLOCK_SIZE);
+}
+
+// Vertex stage benchmark: transforms a fixed stream of 1M random vertices with one concatenated matrix through
+// TransformVertices, then the way the old per-triangle loop did it (world, view and projection as three
+// Matrix_MultiplyVector calls), each for about a quarter of a second
+void RunVertexBenchmark()
+{
+    const size_t count = 1 << 20;
+    VertexStream stream;
+    vector<vec3d> points(count);
+    mt19937 rng(1234);
+    uniform_real_distribution<float> pos(-10.0f, 10.0f);
+    for (size_t i = 0; i < count; i++)
+    {
+        points[i] = { pos(rng), pos(rng), pos(rng) };
+        stream.Add(points[i].x, points[i].y, points[i].z, 0.0f, 0.0f);
     }
-}
\ No newline at end of file
+
+    vec3d eye = { 0, 0, -5 }, target = { 0, 0, 0 }, up = { 0, 1, 0 };
+    mat4x4 matWorld = Matrix_MakeRotationY(0.5f);
+    mat4x4 matCamera = Matrix_PointAt(eye, target, up);
+    mat4x4 matView = Matrix_QuickInverse(matCamera);
+    mat4x4 matProj = Matrix_MakeProjection();
+    mat4x4 matWorldView = Matrix_MultiplyMatrix(matWorld, matView);
+    mat4x4 matWorldViewProj = Matrix_MultiplyMatrix(matWorldView, matProj);
+
+    ClipSpaceBuffer out;
+    out.Resize(count);
+    size_t vertices = 0;
+    double start = GetTime();
+    double elapsed = 0.0;
+    while (elapsed < 0.25)
+    {
+        TransformVertices(matWorldViewProj.m, stream, 0, count, out);
+        vertices += count;
+        elapsed = GetTime() - start;
+    }
+    vertexBench.batchedMverts = vertices / elapsed / 1e6;
+
+    float checksum = 0.0f;
+    vertices = 0;
+    start = GetTime();
+    elapsed = 0.0;
+    while (elapsed < 0.25)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            vec3d world = Matrix_MultiplyVector(matWorld, points[i]);
+            vec3d view = Matrix_MultiplyVector(matView, world);
+            vec3d projected = Matrix_MultiplyVector(matProj, view);
+            checksum += projected.w;
+        }
+        vertices += count;
+        elapsed = GetTime() - start;
+    }
+    vertexBench.perVertexMverts = vertices / elapsed / 1e6;
+
+    TraceLog(LOG_INFO, "VERTEX: batched %.0f Mverts/s (%d wide), per vertex %.0f Mverts/s (checksum %g)", vertexBench.batchedMverts,
+        VERTEX_SIMD_WIDTH, vertexBench.perVertexMverts, checksum);
+}
+
+// Texture benchmark: a full-screen quad with a generated 1024x1024 texture (4 MB, larger than most L2 caches), once
+// minified with the texture repeated 16 times across it and once magnified to a quarter of the texture, rasterized
+// with each filter for about a quarter of a second
+void RunTextureBenchmark(Framebuffer& fb)
+{
+    SoftTexture tex;
+    Image image = GenImageChecked(1024, 1024, 4, 4, ORANGE, DARKBLUE);
+    tex.Load(image);
+    UnloadImage(image);
+
+    const float w = (float)fb.width, h = (float)fb.height;
+    auto measure = [&](TextureFilter filter, float repeat)
+    {
+        tex.filter = filter;
+        const RasterVertex quad[4] = { { 0, 0, 0, 0, 1 }, { w, 0, repeat, 0, 1 }, { w, h, repeat, repeat, 1 }, { 0, h, 0, repeat, 1 } };
+        RasterStats stats;
+        double start = GetTime();
+        double elapsed = 0.0;
+        while (elapsed < 0.25)
+        {
+            fill(fb.depth.begin(), fb.depth.end(), 0.0f);
+            RasterizeTriangle(quad[0], quad[1], quad[2], tex, fb, stats);
+            RasterizeTriangle(quad[0], quad[2], quad[3], tex, fb, stats);
+            elapsed = GetTime() - start;
+        }
+        return stats.written / elapsed / 1e6;
+    };
+
+    for (int f = 0; f < 4; f++)
+    {
+        textureBench.minifiedMpix[f] = measure((TextureFilter)f, 16.0f);
+        textureBench.magnifiedMpix[f] = measure((TextureFilter)f, 0.25f);
+        TraceLog(LOG_INFO, "TEXTURE: %s minified %.1f Mpix/s, magnified %.1f Mpix/s", TextureFilterName((TextureFilter)f),
+            textureBench.minifiedMpix[f], textureBench.magnifiedMpix[f]);
+    }
+}
+
+// Moves the positions and texture coordinates of a loaded OBJ into an IndexedMesh (the renderer has no use for normals)
+void ToIndexedMesh(ObjMesh& obj, IndexedMesh& out)
+{
+    out.verts.x = move(obj.x);
+    out.verts.y = move(obj.y);
+    out.verts.z = move(obj.z);
+    out.verts.u = move(obj.u);
+    out.verts.v = move(obj.v);
+    out.indices = move(obj.indices);
+}
+
+// OBJ benchmark: loads path with the original stream-based loader, then with loadObj on one thread and on every
+// hardware thread, each repeatedly for about a second, and prints the throughput in MB/s. The original loader only
+// understands triangles written as v or v/vt with positive indices; it is skipped for files with normals or polygons.
+void RunObjBenchmark(const char* path)
+{
+    using Clock = chrono::steady_clock;
+    ObjMesh obj;
+    ObjLoadStats stats;
+    if (!loadObj(path, obj, ObjLoadOptions(), &stats))
+    {
+        TraceLog(LOG_WARNING, "OBJ: %s: %s", path, obj.error.c_str());
+        return;
+    }
+    const double megabytes = stats.bytes / 1e6;
+    TraceLog(LOG_INFO, "OBJ: %s: %.1f MB, %zu faces, %zu triangles, %zu unique vertices", path, megabytes, stats.faces,
+        obj.triangleCount(), obj.vertexCount());
+
+    int runs = 0;
+    if (!obj.hasNormals && stats.faces == obj.triangleCount())
+    {
+        const bool bHasTexture = obj.hasTexCoords;
+        double elapsed = 0.0;
+        size_t legacyTriangles = 0;
+        while (elapsed < 1.0)
+        {
+            Clock::time_point start = Clock::now();
+            mesh legacy;
+            legacy.LoadFromObjectFile(path, bHasTexture);
+            elapsed += chrono::duration<double>(Clock::now() - start).count();
+            legacyTriangles = legacy.tris.size();
+            runs++;
+        }
+        TraceLog(LOG_INFO, "OBJ: stream loader %.1f MB/s (%zu triangles, not indexed)", megabytes * runs / elapsed, legacyTriangles);
+    }
+    else
+        TraceLog(LOG_INFO, "OBJ: stream loader skipped, it can't read this file's faces");
+
+    vector<unsigned int> threadCounts = { 1 };
+    if (thread::hardware_concurrency() > 1)
+        threadCounts.push_back(thread::hardware_concurrency());
+    for (unsigned int threads : threadCounts)
+    {
+        ObjLoadOptions options;
+        options.threads = threads;
+        options.parallelThreshold = 0;
+        ObjLoadStats total;
+        runs = 0;
+        while (total.totalMs < 1000.0)
+        {
+            loadObj(path, obj, options, &stats);
+            total.parseMs += stats.parseMs;
+            total.resolveMs += stats.resolveMs;
+            total.dedupMs += stats.dedupMs;
+            total.totalMs += stats.totalMs;
+            runs++;
+        }
+        TraceLog(LOG_INFO, "OBJ: loadObj on %u threads %.1f MB/s (parse %.1f ms, resolve %.1f ms, dedup %.1f ms per load)",
+            threads, megabytes * runs / (total.totalMs / 1000.0), total.parseMs / runs, total.resolveMs / runs,
+            total.dedupMs / runs);
+    }
+}
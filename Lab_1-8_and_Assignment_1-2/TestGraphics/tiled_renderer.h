@@ -0,0 +1,316 @@
+#pragma once
+
+#include "framebuffer.h"
+#include "rasterizer.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Screen tiles are TILE_SIZE x TILE_SIZE pixels (a multiple of RASTER_BLOCK_SIZE)
+#define TILE_SIZE 64
+// Input triangles handed to one front-end job
+#define TILE_CHUNK_SIZE 4096
+// Most triangles one input triangle may turn into (after clipping)
+#define TILE_MAX_OUTPUT_TRIANGLES 8
+
+// Persistent threads for the renderer; Run(fn) calls fn(threadIndex) on every thread, the caller being thread 0,
+// and returns once all of them have finished
+class RenderThreads
+{
+public:
+    explicit RenderThreads(unsigned int count = std::max(1u, std::thread::hardware_concurrency()))
+    {
+        for (unsigned int t = 1; t < count; t++)
+            threads.emplace_back([this, t] { WorkerLoop(t); });
+    }
+
+    ~RenderThreads()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    RenderThreads(const RenderThreads&) = delete;
+    RenderThreads& operator=(const RenderThreads&) = delete;
+
+    unsigned int Count() const { return (unsigned int)threads.size() + 1; }
+
+    template<typename Fn>
+    void Run(Fn& fn)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            invoke = [](void* context, unsigned int t) { (*static_cast<Fn*>(context))(t); };
+            context = &fn;
+            busy = (unsigned int)threads.size();
+            generation++;
+        }
+        wake.notify_all();
+        fn(0u);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping = false;
+    uint64_t generation = 0;
+    unsigned int busy = 0;
+    void (*invoke)(void*, unsigned int) = nullptr;
+    void* context = nullptr;
+
+    void WorkerLoop(unsigned int index)
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            invoke(context, index);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+    }
+};
+
+// Per-frame counters of the tiled renderer
+struct TiledStats
+{
+    size_t inputTriangles = 0;
+    size_t binnedTriangles = 0; // triangles that reached at least one tile
+    size_t tileEntries = 0;     // sum of all tile list lengths
+    double frontEndMs = 0.0;
+    double backEndMs = 0.0;
+    RasterStats raster;
+};
+
+// Two-phase tiled renderer.
+//
+// Front end: input triangles are split into chunks of TILE_CHUNK_SIZE that threads pick up in any order. Each chunk
+// projects its triangles and appends the survivors to its own vertex list and per-tile index lists, so binning needs
+// no locks. Back end: every tile is rasterized by exactly one thread, which owns that tile's colour and depth, so it
+// needs no locks either. A tile walks the chunks in input order, which keeps the draw order within every tile.
+// Tiles are dealt out to the threads in contiguous runs; a thread that finishes its run steals from the others.
+class TiledRenderer
+{
+public:
+    TiledStats stats;
+    bool sortFrontToBack = false; // rasterize each tile's triangles nearest first instead of in draw order
+
+    explicit TiledRenderer(unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency()))
+        : threads(threadCount)
+    {
+    }
+
+    // project(index, out, thread) writes the screen-space triangles for input triangle index to out (3 vertices each,
+    // at most TILE_MAX_OUTPUT_TRIANGLES) and returns how many it wrote. It runs on several threads at once; thread is
+    // in [0, ThreadCount()) and lets it keep per-thread counters
+    template<typename ProjectFn>
+    void Render(Framebuffer& fb, const SoftTexture& tex, size_t triangleCount, ProjectFn& project, Color clearColor)
+    {
+        stats = TiledStats();
+        stats.inputTriangles = triangleCount;
+        Resize(fb, triangleCount);
+
+        // Front end
+        double start = GetTime();
+        std::atomic<size_t> nextChunk(0);
+        auto frontEnd = [&](unsigned int t)
+        {
+            RasterVertex out[TILE_MAX_OUTPUT_TRIANGLES * 3];
+            for (size_t c = nextChunk++; c < chunkCount; c = nextChunk++)
+            {
+                Chunk& chunk = chunks[c];
+                chunk.Clear();
+                const size_t end = std::min(triangleCount, (c + 1) * TILE_CHUNK_SIZE);
+                for (size_t i = c * TILE_CHUNK_SIZE; i < end; i++)
+                {
+                    const int produced = project(i, out, t);
+                    for (int k = 0; k < produced; k++)
+                        Bin(chunk, &out[k * 3]);
+                }
+            }
+        };
+        threads.Run(frontEnd);
+        double mid = GetTime();
+
+        // Back end
+        const unsigned int threadCount = threads.Count();
+        const size_t perThread = (tileCount + threadCount - 1) / threadCount;
+        for (unsigned int t = 0; t < threadCount; t++)
+        {
+            runs[t].next = std::min(tileCount, t * perThread);
+            runs[t].end = std::min(tileCount, (t + 1) * perThread);
+            threadStats[t] = RasterStats();
+        }
+        auto backEnd = [&](unsigned int t)
+        {
+            // own run first, then steal from the others
+            for (unsigned int k = 0; k < threadCount; k++)
+            {
+                TileRun& run = runs[(t + k) % threadCount];
+                for (size_t tile = run.next++; tile < run.end; tile = run.next++)
+                    DrawTile(fb, tex, tile, clearColor, threadStats[t], scratch[t]);
+            }
+        };
+        threads.Run(backEnd);
+        double end = GetTime();
+
+        for (unsigned int t = 0; t < threadCount; t++)
+        {
+            stats.raster.fragments += threadStats[t].fragments;
+            stats.raster.rejected += threadStats[t].rejected;
+            stats.raster.written += threadStats[t].written;
+        }
+        for (size_t c = 0; c < chunkCount; c++)
+        {
+            stats.binnedTriangles += chunks[c].verts.size() / 3;
+            for (const std::vector<uint32_t>& bin : chunks[c].bins)
+                stats.tileEntries += bin.size();
+        }
+        stats.frontEndMs = (mid - start) * 1000.0;
+        stats.backEndMs = (end - mid) * 1000.0;
+    }
+
+    unsigned int ThreadCount() const { return threads.Count(); }
+
+    // calls fn(v0, v1, v2) for every triangle binned last frame, in input order (for the wireframe overlay)
+    template<typename Fn>
+    void ForEachTriangle(Fn fn) const
+    {
+        for (size_t c = 0; c < chunkCount; c++)
+            for (size_t i = 0; i + 2 < chunks[c].verts.size(); i += 3)
+                fn(chunks[c].verts[i], chunks[c].verts[i + 1], chunks[c].verts[i + 2]);
+    }
+
+private:
+    struct Chunk
+    {
+        std::vector<RasterVertex> verts;         // 3 per triangle that survived projection
+        std::vector<float> depthKeys;            // per triangle, for the optional front-to-back order
+        std::vector<std::vector<uint32_t>> bins; // per tile, triangle indices into this chunk in input order
+
+        void Clear()
+        {
+            verts.clear();
+            depthKeys.clear();
+            for (std::vector<uint32_t>& bin : bins)
+                bin.clear();
+        }
+    };
+
+    // a contiguous range of tiles; next is shared so other threads can steal from it
+    struct TileRun
+    {
+        std::atomic<size_t> next{ 0 };
+        size_t end = 0;
+    };
+
+    struct TileRef
+    {
+        float depthKey;
+        uint32_t chunk, index;
+    };
+
+    RenderThreads threads;
+    int tilesX = 0, tilesY = 0;
+    size_t tileCount = 0;
+    size_t chunkCount = 0;
+    std::vector<Chunk> chunks;                   // kept between frames so the lists keep their capacity
+    std::vector<TileRun> runs{ threads.Count() };
+    std::vector<RasterStats> threadStats{ threads.Count() };
+    std::vector<std::vector<TileRef>> scratch{ threads.Count() };
+
+    void Resize(const Framebuffer& fb, size_t triangleCount)
+    {
+        tilesX = (fb.width + TILE_SIZE - 1) / TILE_SIZE;
+        tilesY = (fb.height + TILE_SIZE - 1) / TILE_SIZE;
+        tileCount = (size_t)tilesX * tilesY;
+        chunkCount = (triangleCount + TILE_CHUNK_SIZE - 1) / TILE_CHUNK_SIZE;
+        if (chunks.size() < chunkCount)
+            chunks.resize(chunkCount);
+        for (size_t c = 0; c < chunkCount; c++)
+            if (chunks[c].bins.size() != tileCount)
+                chunks[c].bins.assign(tileCount, std::vector<uint32_t>());
+    }
+
+    // appends a screen-space triangle to every tile its bounding box touches
+    void Bin(Chunk& chunk, const RasterVertex* v)
+    {
+        const float minX = std::min({ v[0].x, v[1].x, v[2].x });
+        const float maxX = std::max({ v[0].x, v[1].x, v[2].x });
+        const float minY = std::min({ v[0].y, v[1].y, v[2].y });
+        const float maxY = std::max({ v[0].y, v[1].y, v[2].y });
+        // written so NaNs are rejected too
+        if (!(maxX >= 0.0f && maxY >= 0.0f && minX < tilesX * TILE_SIZE && minY < tilesY * TILE_SIZE))
+            return;
+
+        const int tx0 = std::max(0, (int)minX / TILE_SIZE);
+        const int ty0 = std::max(0, (int)minY / TILE_SIZE);
+        const int tx1 = std::min(tilesX - 1, (int)std::min(maxX, (float)(tilesX * TILE_SIZE - 1)) / TILE_SIZE);
+        const int ty1 = std::min(tilesY - 1, (int)std::min(maxY, (float)(tilesY * TILE_SIZE - 1)) / TILE_SIZE);
+
+        const uint32_t index = (uint32_t)(chunk.verts.size() / 3);
+        chunk.verts.insert(chunk.verts.end(), v, v + 3);
+        // 1/w is larger nearer the camera, so the nearest vertex has the largest
+        chunk.depthKeys.push_back(-std::max({ v[0].w, v[1].w, v[2].w }));
+        for (int ty = ty0; ty <= ty1; ty++)
+            for (int tx = tx0; tx <= tx1; tx++)
+                chunk.bins[(size_t)ty * tilesX + tx].push_back(index);
+    }
+
+    void DrawTile(Framebuffer& fb, const SoftTexture& tex, size_t tile, Color clearColor, RasterStats& rasterStats,
+        std::vector<TileRef>& refs)
+    {
+        const int tx = (int)(tile % tilesX);
+        const int ty = (int)(tile / tilesX);
+        const RasterRect rect = { tx * TILE_SIZE, ty * TILE_SIZE,
+            std::min(fb.width, (tx + 1) * TILE_SIZE), std::min(fb.height, (ty + 1) * TILE_SIZE) };
+        fb.ClearRect(rect.x0, rect.y0, rect.x1, rect.y1, clearColor);
+
+        if (!sortFrontToBack)
+        {
+            for (size_t c = 0; c < chunkCount; c++)
+            {
+                const Chunk& chunk = chunks[c];
+                for (uint32_t index : chunk.bins[tile])
+                {
+                    const RasterVertex* v = &chunk.verts[(size_t)index * 3];
+                    RasterizeTriangle(v[0], v[1], v[2], tex, fb, rasterStats, rect);
+                }
+            }
+            return;
+        }
+
+        refs.clear();
+        for (size_t c = 0; c < chunkCount; c++)
+            for (uint32_t index : chunks[c].bins[tile])
+                refs.push_back({ chunks[c].depthKeys[index], (uint32_t)c, index });
+        std::stable_sort(refs.begin(), refs.end(), [](const TileRef& a, const TileRef& b) { return a.depthKey < b.depthKey; });
+        for (const TileRef& ref : refs)
+        {
+            const RasterVertex* v = &chunks[ref.chunk].verts[(size_t)ref.index * 3];
+            RasterizeTriangle(v[0], v[1], v[2], tex, fb, rasterStats, rect);
+        }
+    }
+};
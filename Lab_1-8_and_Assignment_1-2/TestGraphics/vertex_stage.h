@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Vertices are transformed VERTEX_SIMD_WIDTH at a time, one SIMD lane per vertex
+#if defined(__AVX2__) || defined(__AVX__)
+#include <immintrin.h>
+#define VERTEX_USE_AVX
+#define VERTEX_SIMD_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VERTEX_USE_SSE2
+#define VERTEX_SIMD_WIDTH 4
+#else
+#define VERTEX_SIMD_WIDTH 1
+#endif
+
+// Unique mesh vertices, stored as one array per component so the transform loads whole SIMD registers
+struct VertexStream
+{
+    std::vector<float> x, y, z;
+    std::vector<float> u, v;
+
+    size_t Size() const { return x.size(); }
+
+    void Clear()
+    {
+        x.clear(); y.clear(); z.clear();
+        u.clear(); v.clear();
+    }
+
+    uint32_t Add(float px, float py, float pz, float tu, float tv)
+    {
+        x.push_back(px); y.push_back(py); z.push_back(pz);
+        u.push_back(tu); v.push_back(tv);
+        return (uint32_t)(x.size() - 1);
+    }
+};
+
+// Triangle list over a VertexStream: 3 indices per triangle
+struct IndexedMesh
+{
+    VertexStream verts;
+    std::vector<uint32_t> indices;
+
+    size_t TriangleCount() const { return indices.size() / 3; }
+};
+
+// Post-transform cache: clip-space position of every vertex of a VertexStream, filled once per frame and then read by
+// every triangle that uses the vertex
+struct ClipSpaceBuffer
+{
+    std::vector<float> x, y, z, w;
+
+    void Resize(size_t count)
+    {
+        x.resize(count); y.resize(count); z.resize(count); w.resize(count);
+    }
+};
+
+// Transforms vertices [first, first + count) of in by m (row vector times matrix, as Matrix_MultiplyVector, with
+// w = 1) into the same slots of out, which must already be large enough
+inline void TransformVertices(const float (&m)[4][4], const VertexStream& in, size_t first, size_t count,
+    ClipSpaceBuffer& out)
+{
+    const float* px = in.x.data();
+    const float* py = in.y.data();
+    const float* pz = in.z.data();
+    float* ox = out.x.data();
+    float* oy = out.y.data();
+    float* oz = out.z.data();
+    float* ow = out.w.data();
+
+    size_t i = first;
+    const size_t end = first + count;
+
+#if defined(VERTEX_USE_AVX)
+    __m256 col[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            col[r][c] = _mm256_set1_ps(m[r][c]);
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m256 x = _mm256_loadu_ps(px + i);
+        const __m256 y = _mm256_loadu_ps(py + i);
+        const __m256 z = _mm256_loadu_ps(pz + i);
+        float* dst[4] = { ox + i, oy + i, oz + i, ow + i };
+        for (int c = 0; c < 4; c++)
+        {
+            __m256 r = _mm256_add_ps(_mm256_mul_ps(x, col[0][c]), _mm256_mul_ps(y, col[1][c]));
+            r = _mm256_add_ps(r, _mm256_mul_ps(z, col[2][c]));
+            _mm256_storeu_ps(dst[c], _mm256_add_ps(r, col[3][c]));
+        }
+    }
+#elif defined(VERTEX_USE_SSE2)
+    __m128 col[4][4];
+    for (int r = 0; r < 4; r++)
+        for (int c = 0; c < 4; c++)
+            col[r][c] = _mm_set1_ps(m[r][c]);
+    for (; i + 4 <= end; i += 4)
+    {
+        const __m128 x = _mm_loadu_ps(px + i);
+        const __m128 y = _mm_loadu_ps(py + i);
+        const __m128 z = _mm_loadu_ps(pz + i);
+        float* dst[4] = { ox + i, oy + i, oz + i, ow + i };
+        for (int c = 0; c < 4; c++)
+        {
+            __m128 r = _mm_add_ps(_mm_mul_ps(x, col[0][c]), _mm_mul_ps(y, col[1][c]));
+            r = _mm_add_ps(r, _mm_mul_ps(z, col[2][c]));
+            _mm_storeu_ps(dst[c], _mm_add_ps(r, col[3][c]));
+        }
+    }
+#endif
+
+    // the remainder, summed in the same order as the SIMD lanes
+    for (; i < end; i++)
+    {
+        ox[i] = px[i] * m[0][0] + py[i] * m[1][0] + pz[i] * m[2][0] + m[3][0];
+        oy[i] = px[i] * m[0][1] + py[i] * m[1][1] + pz[i] * m[2][1] + m[3][1];
+        oz[i] = px[i] * m[0][2] + py[i] * m[1][2] + pz[i] * m[2][2] + m[3][2];
+        ow[i] = px[i] * m[0][3] + py[i] * m[1][3] + pz[i] * m[2][3] + m[3][3];
+    }
+}
+
+// Transforms the whole stream, resizing out to match
+inline void TransformVertices(const float (&m)[4][4], const VertexStream& in, ClipSpaceBuffer& out)
+{
+    out.Resize(in.Size());
+    TransformVertices(m, in, 0, in.Size(), out);
+}
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <glm/glm.hpp>
 #include <assimp/scene.h>
 #include <learnopengl/bone.h>
@@ -15,6 +17,30 @@ struct AssimpNodeData
 	std::string name;
 	int childrenCount;
 	std::vector<AssimpNodeData> children;
+
+	//resolved once by Animation::BindHierarchy so evaluation never looks anything up by name
+	int channelIndex = -1; //index into the animation's bones (keyframe channels), -1 if the node isn't animated
+	int boneIndex = -1;    //index into the final bone matrices, -1 if no vertex is skinned to this node
+	glm::mat4 boneOffset = glm::mat4(1.0f);
+};
+
+//The node hierarchy flattened in depth-first order, so every parent comes before its children and a pose is evaluated
+//with one forward loop: global[i] = global[parents[i]] * local[i]. Built once per animation after binding.
+struct FlatHierarchy
+{
+	std::vector<int> parents;            //-1 for the root
+	std::vector<glm::mat4> bindLocal;    //AssimpNodeData::transformation, used when a node has no channel
+	std::vector<int> channels;           //AssimpNodeData::channelIndex
+	std::vector<int> bones;              //AssimpNodeData::boneIndex
+	std::vector<glm::mat4> boneOffsets;  //AssimpNodeData::boneOffset
+	std::vector<std::string> names;      //AssimpNodeData::name, to match nodes between clips of the same model
+	//bindLocal split into translation, rotation and scale, used when blending poses
+	std::vector<glm::vec3> bindPositions;
+	std::vector<glm::quat> bindRotations;
+	std::vector<glm::vec3> bindScales;
+	int paletteSize = 0;                 //highest bone index + 1, the number of final bone matrices a pose writes
+
+	size_t size() const { return parents.size(); }
 };
 
 class Animation
@@ -34,6 +60,21 @@ public:
 		globalTransformation = globalTransformation.Inverse();
 		ReadHierarchyData(m_RootNode, scene->mRootNode);
 		ReadMissingBones(animation, *model);
+		BindHierarchy(m_RootNode);
+		FlattenHierarchy(m_RootNode, -1);
+	}
+
+	//builds an animation from a node tree and channels that didn't come from an Assimp file (procedural or synthetic
+	//rigs). Channels are matched to nodes by name and bones come from boneInfoMap, exactly as when loading a file.
+	Animation(const AssimpNodeData& root, std::vector<Bone> channels, const std::map<std::string, BoneInfo>& boneInfoMap,
+		float duration, int ticksPerSecond)
+		: m_Duration(duration), m_TicksPerSecond(ticksPerSecond), m_Bones(std::move(channels)), m_RootNode(root),
+		m_BoneInfoMap(boneInfoMap)
+	{
+		for (size_t i = 0; i < m_Bones.size(); i++)
+			m_BoneIndices[m_Bones[i].GetBoneName()] = static_cast<int>(i);
+		BindHierarchy(m_RootNode);
+		FlattenHierarchy(m_RootNode, -1);
 	}
 
 	~Animation()
@@ -42,20 +83,28 @@ public:
 
 	Bone* FindBone(const std::string& name)
 	{
-		auto iter = std::find_if(m_Bones.begin(), m_Bones.end(),
-			[&](const Bone& Bone)
-			{
-				return Bone.GetBoneName() == name;
-			}
-		);
-		if (iter == m_Bones.end()) return nullptr;
-		else return &(*iter);
+		auto iter = m_BoneIndices.find(name);
+		if (iter == m_BoneIndices.end()) return nullptr;
+		else return &m_Bones[iter->second];
+	}
+
+	//index of the channel animating the named node, -1 if this animation doesn't animate it
+	int FindBoneIndex(const std::string& name) const
+	{
+		auto iter = m_BoneIndices.find(name);
+		return iter == m_BoneIndices.end() ? -1 : iter->second;
 	}
 
+	//channel as resolved into AssimpNodeData::channelIndex
+	inline Bone& GetBone(int channelIndex) { return m_Bones[channelIndex]; }
+	inline const Bone& GetBone(int channelIndex) const { return m_Bones[channelIndex]; }
+	inline int GetBoneCount() const { return static_cast<int>(m_Bones.size()); }
+
 	
-	inline float GetTicksPerSecond() { return m_TicksPerSecond; }
-	inline float GetDuration() { return m_Duration;}
+	inline float GetTicksPerSecond() const { return m_TicksPerSecond; }
+	inline float GetDuration() const { return m_Duration;}
 	inline const AssimpNodeData& GetRootNode() { return m_RootNode; }
+	inline const FlatHierarchy& GetFlatHierarchy() const { return m_Flat; }
 	inline const std::map<std::string,BoneInfo>& GetBoneIDMap() 
 	{ 
 		return m_BoneInfoMap;
@@ -80,6 +129,7 @@ private:
 				boneInfoMap[boneName].id = boneCount;
 				boneCount++;
 			}
+			m_BoneIndices[boneName] = static_cast<int>(m_Bones.size());
 			m_Bones.push_back(Bone(channel->mNodeName.data,
 				boneInfoMap[channel->mNodeName.data].id, channel));
 		}
@@ -87,6 +137,51 @@ private:
 		m_BoneInfoMap = boneInfoMap;
 	}
 
+	//resolves every node's channel and bone by name once, after loading
+	void BindHierarchy(AssimpNodeData& node)
+	{
+		auto channel = m_BoneIndices.find(node.name);
+		node.channelIndex = channel != m_BoneIndices.end() ? channel->second : -1;
+
+		auto bone = m_BoneInfoMap.find(node.name);
+		if (bone != m_BoneInfoMap.end())
+		{
+			node.boneIndex = bone->second.id;
+			node.boneOffset = bone->second.offset;
+		}
+		else
+			node.boneIndex = -1;
+
+		for (AssimpNodeData& child : node.children)
+			BindHierarchy(child);
+	}
+
+	void FlattenHierarchy(const AssimpNodeData& node, int parent)
+	{
+		const int index = static_cast<int>(m_Flat.size());
+		m_Flat.parents.push_back(parent);
+		m_Flat.bindLocal.push_back(node.transformation);
+		m_Flat.channels.push_back(node.channelIndex);
+		m_Flat.bones.push_back(node.boneIndex);
+		m_Flat.boneOffsets.push_back(node.boneOffset);
+		m_Flat.paletteSize = std::max(m_Flat.paletteSize, node.boneIndex + 1);
+		m_Flat.names.push_back(node.name);
+
+		//node transforms are translation * rotation * scale without shear, so the columns give the scale directly
+		const glm::mat4& local = node.transformation;
+		const glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])), glm::length(glm::vec3(local[2])));
+		glm::mat3 rotation(1.0f);
+		for (int c = 0; c < 3; c++)
+			if (scale[c] > 0.0f)
+				rotation[c] = glm::vec3(local[c]) / scale[c];
+		m_Flat.bindPositions.push_back(glm::vec3(local[3]));
+		m_Flat.bindRotations.push_back(glm::normalize(glm::quat_cast(rotation)));
+		m_Flat.bindScales.push_back(scale);
+
+		for (const AssimpNodeData& child : node.children)
+			FlattenHierarchy(child, index);
+	}
+
 	void ReadHierarchyData(AssimpNodeData& dest, const aiNode* src)
 	{
 		assert(src);
@@ -105,7 +200,9 @@ private:
 	float m_Duration;
 	int m_TicksPerSecond;
 	std::vector<Bone> m_Bones;
+	std::unordered_map<std::string, int> m_BoneIndices; //bone name -> index into m_Bones
 	AssimpNodeData m_RootNode;
+	FlatHierarchy m_Flat;
 	std::map<std::string, BoneInfo> m_BoneInfoMap;
 };
 
@@ -0,0 +1,359 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <learnopengl/animation.h>
+#include <learnopengl/animator.h>
+#include <learnopengl/bone.h>
+
+#define MAX_BLEND_LAYERS 8
+
+//Local (parent relative) transforms of every node of a flat hierarchy, as separate arrays so blending walks each one
+struct LocalPose
+{
+	std::vector<glm::vec3> positions;
+	std::vector<glm::quat> rotations;
+	std::vector<glm::vec3> scales;
+
+	void resize(size_t count)
+	{
+		positions.resize(count);
+		rotations.resize(count);
+		scales.resize(count);
+	}
+
+	size_t size() const { return positions.size(); }
+};
+
+enum class BlendMode
+{
+	Override, //replaces the layers below, by the layer's weight
+	Additive  //adds the clip's difference from its first frame on top of the layers below
+};
+
+//Per node weights in [0, 1] that restrict a layer to part of the skeleton, e.g. the upper body
+struct BoneMask
+{
+	std::vector<float> weights;
+
+	BoneMask(const FlatHierarchy& hierarchy, float weight = 0.0f)
+		: weights(hierarchy.size(), weight)
+	{
+	}
+
+	//sets the named node and everything below it. In depth-first order a subtree is the run of nodes after its root
+	//whose parents lie inside the subtree, so it ends at the first node with a parent before the root.
+	void SetSubtree(const FlatHierarchy& hierarchy, const std::string& name, float weight)
+	{
+		auto iter = std::find(hierarchy.names.begin(), hierarchy.names.end(), name);
+		if (iter == hierarchy.names.end())
+			return;
+		const int root = static_cast<int>(iter - hierarchy.names.begin());
+		weights[root] = weight;
+		for (size_t i = root + 1; i < hierarchy.size() && hierarchy.parents[i] >= root; i++)
+			weights[i] = weight;
+	}
+};
+
+//What a layer cost in the last Update()
+struct BlendLayerStats
+{
+	int clipsSampled = 0;  //2 while cross-fading
+	double sampleMs = 0.0; //sampling keyframes (and the cross-fade between the two clips)
+	double blendMs = 0.0;  //combining the layer with the ones below
+};
+
+//normalised lerp along the shorter arc; at blend weights it's indistinguishable from slerp and a lot cheaper
+inline glm::quat BlendRotation(const glm::quat& a, const glm::quat& b, float t)
+{
+	const glm::quat target = glm::dot(a, b) < 0.0f ? -b : b;
+	return glm::normalize(a * (1.0f - t) + target * t);
+}
+
+//Plays several clips of one model at once. Each layer samples its clip into a local TRS pose (two clips while it
+//cross-fades), the layers are blended bottom to top, override or additive and optionally masked, and the result goes
+//through the same flat hierarchy pass as Animator. All poses are allocated up front, so Update() doesn't allocate.
+class AnimationBlender
+{
+public:
+	//skeleton is any clip of the model; every other clip is matched to its hierarchy by node name
+	AnimationBlender(Animation* skeleton)
+		: m_Skeleton(skeleton)
+	{
+		const size_t count = skeleton->GetFlatHierarchy().size();
+		m_Pose.resize(count);
+		m_LayerPose.resize(count);
+		m_FadePose.resize(count);
+		m_GlobalTransforms.resize(count);
+		m_FinalBoneMatrices.assign(MAX_BONES, glm::mat4(1.0f));
+	}
+
+	//plays animation on a layer, cross-fading from whatever the layer was playing over fadeSeconds
+	void Play(Animation* animation, float fadeSeconds = 0.0f, int layer = 0)
+	{
+		Layer& target = m_Layers[layer];
+		if (fadeSeconds > 0.0f && target.active && target.current.binding)
+		{
+			std::swap(target.previous, target.current);
+			target.fadeDuration = fadeSeconds;
+			target.fadeElapsed = 0.0f;
+		}
+		else
+			target.previous.binding = nullptr;
+
+		Start(target.current, animation);
+		target.active = true;
+	}
+
+	//sets up a layer above the base one; mask must outlive the layer and be built from GetHierarchy()
+	void SetLayer(int layer, Animation* animation, BlendMode mode, float weight = 1.0f, const BoneMask* mask = nullptr, float fadeSeconds = 0.0f)
+	{
+		m_Layers[layer].mode = mode;
+		m_Layers[layer].weight = weight;
+		m_Layers[layer].mask = mask;
+		Play(animation, fadeSeconds, layer);
+	}
+
+	void SetLayerWeight(int layer, float weight) { m_Layers[layer].weight = weight; }
+
+	void StopLayer(int layer)
+	{
+		m_Layers[layer].active = false;
+		m_Layers[layer].stats = BlendLayerStats();
+	}
+
+	void UpdateAnimation(float dt)
+	{
+		typedef std::chrono::high_resolution_clock Clock;
+		const FlatHierarchy& hierarchy = m_Skeleton->GetFlatHierarchy();
+
+		std::copy(hierarchy.bindPositions.begin(), hierarchy.bindPositions.end(), m_Pose.positions.begin());
+		std::copy(hierarchy.bindRotations.begin(), hierarchy.bindRotations.end(), m_Pose.rotations.begin());
+		std::copy(hierarchy.bindScales.begin(), hierarchy.bindScales.end(), m_Pose.scales.begin());
+
+		for (Layer& layer : m_Layers)
+		{
+			if (!layer.active)
+				continue;
+			const auto sampleStart = Clock::now();
+			const bool additive = layer.mode == BlendMode::Additive;
+
+			Advance(layer.current, dt);
+			Sample(layer.current, additive, m_LayerPose);
+			layer.stats.clipsSampled = 1;
+			if (layer.previous.binding)
+			{
+				layer.fadeElapsed += dt;
+				if (layer.fadeElapsed >= layer.fadeDuration)
+					layer.previous.binding = nullptr;
+				else
+				{
+					Advance(layer.previous, dt);
+					Sample(layer.previous, additive, m_FadePose);
+					BlendPoses(m_FadePose, m_LayerPose, layer.fadeElapsed / layer.fadeDuration, nullptr, m_LayerPose);
+					layer.stats.clipsSampled = 2;
+				}
+			}
+
+			const auto blendStart = Clock::now();
+			if (additive)
+				AddPose(m_Pose, m_LayerPose, layer.weight, layer.mask);
+			else
+				BlendPoses(m_Pose, m_LayerPose, layer.weight, layer.mask, m_Pose);
+			const auto blendEnd = Clock::now();
+
+			layer.stats.sampleMs = std::chrono::duration<double, std::milli>(blendStart - sampleStart).count();
+			layer.stats.blendMs = std::chrono::duration<double, std::milli>(blendEnd - blendStart).count();
+		}
+
+		CalculateBoneTransforms();
+	}
+
+	//out = mix(a, b, weight * mask); out may be a or b
+	static void BlendPoses(const LocalPose& a, const LocalPose& b, float weight, const BoneMask* mask, LocalPose& out)
+	{
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			const float w = mask ? weight * mask->weights[i] : weight;
+			out.positions[i] = glm::mix(a.positions[i], b.positions[i], w);
+			out.rotations[i] = BlendRotation(a.rotations[i], b.rotations[i], w);
+			out.scales[i] = glm::mix(a.scales[i], b.scales[i], w);
+		}
+	}
+
+	//applies an additive (difference) pose on top of pose, scaled by weight * mask
+	static void AddPose(LocalPose& pose, const LocalPose& difference, float weight, const BoneMask* mask)
+	{
+		const glm::quat identity(1.0f, 0.0f, 0.0f, 0.0f);
+		for (size_t i = 0; i < pose.size(); i++)
+		{
+			const float w = mask ? weight * mask->weights[i] : weight;
+			if (w <= 0.0f)
+				continue;
+			pose.positions[i] += difference.positions[i] * w;
+			pose.rotations[i] = glm::normalize(pose.rotations[i] * BlendRotation(identity, difference.rotations[i], w));
+			pose.scales[i] *= glm::mix(glm::vec3(1.0f), difference.scales[i], w);
+		}
+	}
+
+	const FlatHierarchy& GetHierarchy() const { return m_Skeleton->GetFlatHierarchy(); }
+
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const { return m_FinalBoneMatrices; }
+
+	BonePalette GetBonePalette() const
+	{
+		return { m_FinalBoneMatrices.data(), m_FinalBoneMatrices.size() };
+	}
+
+	const BlendLayerStats& GetLayerStats(int layer) const { return m_Layers[layer].stats; }
+
+	double GetHierarchyMs() const { return m_HierarchyMs; }
+
+	void PrintStats() const
+	{
+		for (int i = 0; i < MAX_BLEND_LAYERS; i++)
+		{
+			if (!m_Layers[i].active)
+				continue;
+			const BlendLayerStats& stats = m_Layers[i].stats;
+			std::cout << "ANIMATION::BLEND layer " << i << ": " << stats.clipsSampled << " clip(s), sample "
+				<< stats.sampleMs << " ms, blend " << stats.blendMs << " ms" << std::endl;
+		}
+		std::cout << "ANIMATION::BLEND hierarchy: " << m_HierarchyMs << " ms" << std::endl;
+	}
+
+private:
+	//a clip matched to the skeleton, built once per clip the first time it's played
+	struct ClipBinding
+	{
+		const Animation* clip = nullptr;
+		std::vector<int> channels; //per skeleton node, the clip's channel or -1
+		LocalPose reference;       //the clip's first frame, what additive layers are relative to
+	};
+
+	struct ClipState
+	{
+		const ClipBinding* binding = nullptr;
+		float time = 0.0f;
+		std::vector<KeyCursor> cursors; //per channel of the clip
+	};
+
+	struct Layer
+	{
+		bool active = false;
+		BlendMode mode = BlendMode::Override;
+		float weight = 1.0f;
+		const BoneMask* mask = nullptr;
+		ClipState current;
+		ClipState previous; //faded out over fadeDuration seconds
+		float fadeDuration = 0.0f;
+		float fadeElapsed = 0.0f;
+		BlendLayerStats stats;
+	};
+
+	Animation* m_Skeleton;
+	std::array<Layer, MAX_BLEND_LAYERS> m_Layers;
+	std::vector<std::unique_ptr<ClipBinding>> m_Bindings;
+
+	//scratch, sized once to the skeleton
+	LocalPose m_Pose;
+	LocalPose m_LayerPose;
+	LocalPose m_FadePose;
+	std::vector<glm::mat4> m_GlobalTransforms;
+	std::vector<glm::mat4> m_FinalBoneMatrices;
+	double m_HierarchyMs = 0.0;
+
+	const ClipBinding* Bind(const Animation* clip)
+	{
+		for (const std::unique_ptr<ClipBinding>& binding : m_Bindings)
+			if (binding->clip == clip)
+				return binding.get();
+
+		const FlatHierarchy& hierarchy = m_Skeleton->GetFlatHierarchy();
+		std::unique_ptr<ClipBinding> binding(new ClipBinding());
+		binding->clip = clip;
+		binding->channels.resize(hierarchy.size());
+		for (size_t i = 0; i < hierarchy.size(); i++)
+			binding->channels[i] = clip->FindBoneIndex(hierarchy.names[i]);
+
+		ClipState first;
+		first.binding = binding.get();
+		first.cursors.resize(clip->GetBoneCount());
+		binding->reference.resize(hierarchy.size());
+		Sample(first, false, binding->reference);
+
+		m_Bindings.push_back(std::move(binding));
+		return m_Bindings.back().get();
+	}
+
+	void Start(ClipState& state, const Animation* clip)
+	{
+		state.binding = Bind(clip);
+		state.time = 0.0f;
+		state.cursors.assign(clip->GetBoneCount(), KeyCursor());
+	}
+
+	static void Advance(ClipState& state, float dt)
+	{
+		const Animation& clip = *state.binding->clip;
+		state.time += clip.GetTicksPerSecond() * dt;
+		state.time = fmod(state.time, clip.GetDuration());
+	}
+
+	//samples a clip into local TRS; with additive set, as the difference from the clip's first frame
+	void Sample(ClipState& state, bool additive, LocalPose& out) const
+	{
+		const FlatHierarchy& hierarchy = m_Skeleton->GetFlatHierarchy();
+		const ClipBinding& binding = *state.binding;
+		for (size_t i = 0; i < hierarchy.size(); i++)
+		{
+			const int channel = binding.channels[i];
+			if (channel < 0)
+			{
+				out.positions[i] = additive ? glm::vec3(0.0f) : hierarchy.bindPositions[i];
+				out.rotations[i] = additive ? glm::quat(1.0f, 0.0f, 0.0f, 0.0f) : hierarchy.bindRotations[i];
+				out.scales[i] = additive ? glm::vec3(1.0f) : hierarchy.bindScales[i];
+				continue;
+			}
+
+			binding.clip->GetBone(channel).SampleTRS(state.time, state.cursors[channel], out.positions[i], out.rotations[i], out.scales[i]);
+			if (additive)
+			{
+				out.positions[i] -= binding.reference.positions[i];
+				out.rotations[i] = glm::inverse(binding.reference.rotations[i]) * out.rotations[i];
+				out.scales[i] /= binding.reference.scales[i];
+			}
+		}
+	}
+
+	//the blended local pose through the flat hierarchy, as in Animator::EvaluatePose
+	void CalculateBoneTransforms()
+	{
+		const auto start = std::chrono::high_resolution_clock::now();
+		const FlatHierarchy& hierarchy = m_Skeleton->GetFlatHierarchy();
+		const int paletteSize = static_cast<int>(m_FinalBoneMatrices.size());
+		glm::mat4 local;
+		for (size_t i = 0; i < hierarchy.size(); i++)
+		{
+			ComposeTransform(m_Pose.positions[i], m_Pose.rotations[i], m_Pose.scales[i], local);
+
+			const int parent = hierarchy.parents[i];
+			if (parent >= 0)
+				MultiplyMat4(m_GlobalTransforms[parent], local, m_GlobalTransforms[i]);
+			else
+				m_GlobalTransforms[i] = local;
+
+			const int boneIndex = hierarchy.bones[i];
+			if (boneIndex >= 0 && boneIndex < paletteSize)
+				MultiplyMat4(m_GlobalTransforms[i], hierarchy.boneOffsets[i], m_FinalBoneMatrices[boneIndex]);
+		}
+		m_HierarchyMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	}
+};
@@ -0,0 +1,242 @@
+#ifndef ANIMATION_CROWD_H
+#define ANIMATION_CROWD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/animation.h>
+#include <learnopengl/animator.h>
+#include <learnopengl/bone.h>
+#include <learnopengl/mesh.h>
+#include <learnopengl/parallel.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+// texture unit the palette buffer texture is bound to; kept clear of the units Mesh::Draw uses for material textures
+#define CROWD_PALETTE_TEXTURE_UNIT 15
+// instances evaluated per worker job; large enough to amortise the hand-out, small enough to balance
+#define CROWD_JOB_SIZE 16
+
+// Per-frame counters filled in by AnimationCrowd.
+struct CrowdStats
+{
+    unsigned int instances = 0;
+    unsigned int drawCalls = 0;
+    size_t       triangles = 0;
+    size_t       paletteBytes = 0; // uploaded by the last Upload()
+    double       updateMs = 0.0;   // wall time of the last Update(), all worker threads included
+};
+
+// Animates many skinned characters at once. Instances live in contiguous arrays and their poses are evaluated in
+// parallel on a WorkerPool; every instance only owns its play time and keyframe cursors, the Animation (keyframes and
+// hierarchy) is shared and read-only during Update(). The results go into one palette array laid out per instance as
+// [model matrix, bone 0, bone 1, ...], PaletteStride() matrices each, which Upload() copies into a buffer texture so a
+// single glDrawElementsInstanced draws a whole range of characters (see shaders/anim_model_crowd.vs).
+// A buffer texture is used rather than a shader storage buffer to stay within OpenGL 3.3.
+class AnimationCrowd
+{
+public:
+    CrowdStats stats;
+
+    explicit AnimationCrowd(unsigned int threadCount = WorkerCount())
+        : pool(threadCount)
+    {
+    }
+
+    ~AnimationCrowd()
+    {
+        if (paletteTexture)
+            glDeleteTextures(1, &paletteTexture);
+        if (paletteBuffer)
+            glDeleteBuffers(1, &paletteBuffer);
+    }
+
+    AnimationCrowd(const AnimationCrowd&) = delete;
+    AnimationCrowd& operator=(const AnimationCrowd&) = delete;
+
+    // adds a character playing animation from startTime (in ticks) at speed times the clip's rate; returns its index
+    size_t Add(Animation* animation, float startTime = 0.0f, float speed = 1.0f, const glm::mat4& modelMatrix = glm::mat4(1.0f))
+    {
+        Instance instance;
+        instance.animation = animation;
+        instance.time = startTime;
+        instance.speed = speed;
+        instance.cursorOffset = cursors.size();
+        instance.cursorCount = animation->GetBoneCount();
+        cursors.resize(cursors.size() + instance.cursorCount);
+        instances.push_back(instance);
+        transforms.push_back(modelMatrix);
+        growStride(animation);
+        return instances.size() - 1;
+    }
+
+    // switches a character to another clip, restarting it at startTime
+    void Play(size_t index, Animation* animation, float startTime = 0.0f)
+    {
+        Instance& instance = instances[index];
+        instance.animation = animation;
+        instance.time = startTime;
+        if (animation->GetBoneCount() > instance.cursorCount)
+        {
+            // the old cursor range is too small; the new one goes at the end (the old slots are simply left unused)
+            instance.cursorOffset = cursors.size();
+            instance.cursorCount = animation->GetBoneCount();
+            cursors.resize(cursors.size() + instance.cursorCount);
+        }
+        std::fill_n(cursors.begin() + instance.cursorOffset, instance.cursorCount, KeyCursor());
+        growStride(animation);
+    }
+
+    void SetSpeed(size_t index, float speed) { instances[index].speed = speed; }
+    void SetTransform(size_t index, const glm::mat4& modelMatrix) { transforms[index] = modelMatrix; }
+
+    size_t Size() const { return instances.size(); }
+
+    // matrices per instance in the palette: the model matrix followed by the bone matrices
+    int PaletteStride() const { return paletteStride; }
+
+    // advances every character by dt seconds and evaluates all poses in parallel
+    void Update(float dt)
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        palettes.resize(instances.size() * paletteStride);
+
+        const size_t jobCount = (instances.size() + CROWD_JOB_SIZE - 1) / CROWD_JOB_SIZE;
+        auto job = [this, dt](size_t j)
+        {
+            // per thread scratch for the global node transforms; pool threads persist, so this stops allocating quickly
+            thread_local std::vector<glm::mat4> globals;
+
+            const size_t end = std::min(instances.size(), (j + 1) * CROWD_JOB_SIZE);
+            for (size_t i = j * CROWD_JOB_SIZE; i < end; i++)
+            {
+                Instance& instance = instances[i];
+                glm::mat4* palette = &palettes[i * paletteStride];
+                palette[0] = transforms[i];
+                if (!instance.animation)
+                    continue;
+
+                const Animation& animation = *instance.animation;
+                instance.time += animation.GetTicksPerSecond() * instance.speed * dt;
+                instance.time = std::fmod(instance.time, animation.GetDuration());
+                if (instance.time < 0.0f)
+                    instance.time += animation.GetDuration();
+
+                const FlatHierarchy& hierarchy = animation.GetFlatHierarchy();
+                if (globals.size() < hierarchy.size())
+                    globals.resize(hierarchy.size());
+                Animator::EvaluatePose(animation, instance.time, &cursors[instance.cursorOffset], globals.data(),
+                    palette + 1, paletteStride - 1);
+            }
+        };
+        pool.Run(jobCount, job);
+        stats.updateMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // the model matrix of a character as last written by Update()
+    const glm::mat4& GetTransform(size_t index) const { return palettes[index * paletteStride]; }
+
+    // the bone matrices of a character as last evaluated by Update(); valid until the next Update()
+    BonePalette GetFinalBoneMatrices(size_t index) const
+    {
+        return { &palettes[index * paletteStride + 1], size_t(paletteStride - 1) };
+    }
+
+    // copies every palette into the buffer texture. GL thread only; call once per frame after Update().
+    void Upload()
+    {
+        if (!paletteBuffer)
+        {
+            glGenBuffers(1, &paletteBuffer);
+            glGenTextures(1, &paletteTexture);
+        }
+
+        const size_t bytes = palettes.size() * sizeof(glm::mat4);
+        glBindBuffer(GL_TEXTURE_BUFFER, paletteBuffer);
+        if (bytes > capacity)
+            capacity = bytes + bytes / 2;
+        // orphan last frame's storage so we don't wait on draws that are still reading it
+        glBufferData(GL_TEXTURE_BUFFER, capacity, NULL, GL_STREAM_DRAW);
+        if (bytes)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, palettes.data());
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, paletteBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+        const double updateMs = stats.updateMs;
+        stats = CrowdStats();
+        stats.updateMs = updateMs;
+        stats.instances = static_cast<unsigned int>(instances.size());
+        stats.paletteBytes = bytes;
+    }
+
+    // draws count characters starting at first, all sharing model, with one instanced draw per mesh
+    template<typename TModel>
+    void Draw(Shader& shader, TModel& model, size_t first, size_t count, unsigned int lod = 0)
+    {
+        count = std::min(count, instances.size() - std::min(first, instances.size()));
+        if (count == 0)
+            return;
+
+        shader.use();
+        glActiveTexture(GL_TEXTURE0 + CROWD_PALETTE_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, paletteTexture);
+        shader.setInt("bonePalettes", CROWD_PALETTE_TEXTURE_UNIT);
+        shader.setInt("paletteStride", paletteStride);
+        shader.setInt("paletteBase", static_cast<int>(first));
+
+        for (Mesh& mesh : model.meshes)
+        {
+            const MeshLod& level = mesh.Lod(lod);
+            for (unsigned int i = 0; i < mesh.textures.size(); i++)
+            {
+                glActiveTexture(GL_TEXTURE0 + i);
+                shader.setInt(mesh.samplerNames[i], i);
+                glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+            }
+            glBindVertexArray(mesh.VAO);
+            glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(unsigned int)), static_cast<GLsizei>(count));
+            stats.drawCalls++;
+            stats.triangles += size_t(level.indexCount / 3) * count;
+        }
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    struct Instance
+    {
+        Animation* animation = nullptr;
+        float time = 0.0f;  // in ticks
+        float speed = 1.0f;
+        size_t cursorOffset = 0;
+        int cursorCount = 0;
+    };
+
+    WorkerPool pool;
+
+    std::vector<Instance> instances;
+    std::vector<glm::mat4> transforms;
+    std::vector<KeyCursor> cursors;   // every instance's keyframe cursors, one per channel of its animation
+    std::vector<glm::mat4> palettes;  // paletteStride matrices per instance
+    int paletteStride = 1;
+
+    unsigned int paletteBuffer = 0;
+    unsigned int paletteTexture = 0;
+    size_t capacity = 0; // in bytes
+
+    // the stride only grows, so palettes of every clip added so far fit; it's clamped to what the shaders declare
+    void growStride(const Animation* animation)
+    {
+        const int bones = std::min(animation->GetFlatHierarchy().paletteSize, MAX_BONES);
+        paletteStride = std::max(paletteStride, bones + 1);
+    }
+};
+#endif
@@ -8,6 +8,49 @@
 #include <learnopengl/animation.h>
 #include <learnopengl/bone.h>
 
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ANIMATOR_USE_SSE
+#endif
+
+//size of every bone palette; matches MAX_BONES in the skinning shaders
+#define MAX_BONES 100
+
+//Non-owning view of a bone palette, handed out instead of copying the matrices
+struct BonePalette
+{
+	const glm::mat4* data = nullptr;
+	size_t size = 0;
+
+	const glm::mat4& operator[](size_t i) const { return data[i]; }
+	const glm::mat4* begin() const { return data; }
+	const glm::mat4* end() const { return data + size; }
+};
+
+//out = a * b for column-major matrices: each column of out is a linear combination of a's columns, 4 floats wide
+inline void MultiplyMat4(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#ifdef ANIMATOR_USE_SSE
+	const float* pa = &a[0][0];
+	const float* pb = &b[0][0];
+	float* po = &out[0][0];
+	const __m128 a0 = _mm_loadu_ps(pa);
+	const __m128 a1 = _mm_loadu_ps(pa + 4);
+	const __m128 a2 = _mm_loadu_ps(pa + 8);
+	const __m128 a3 = _mm_loadu_ps(pa + 12);
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(pb[c * 4 + 0]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(pb[c * 4 + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(pb[c * 4 + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(pb[c * 4 + 3])));
+		_mm_storeu_ps(po + c * 4, column);
+	}
+#else
+	out = a * b;
+#endif
+}
+
 class Animator
 {
 public:
@@ -16,9 +59,9 @@ public:
 		m_CurrentTime = 0.0;
 		m_CurrentAnimation = animation;
 
-		m_FinalBoneMatrices.reserve(100);
+		m_FinalBoneMatrices.reserve(MAX_BONES);
 
-		for (int i = 0; i < 100; i++)
+		for (int i = 0; i < MAX_BONES; i++)
 			m_FinalBoneMatrices.push_back(glm::mat4(1.0f));
 	}
 
@@ -29,7 +72,7 @@ public:
 		{
 			m_CurrentTime += m_CurrentAnimation->GetTicksPerSecond() * dt;
 			m_CurrentTime = fmod(m_CurrentTime, m_CurrentAnimation->GetDuration());
-			CalculateBoneTransform(&m_CurrentAnimation->GetRootNode(), glm::mat4(1.0f));
+			CalculateBoneTransforms();
 		}
 	}
 
@@ -37,42 +80,66 @@ public:
 	{
 		m_CurrentAnimation = pAnimation;
 		m_CurrentTime = 0.0f;
+		m_Cursors.clear();
 	}
 
-	void CalculateBoneTransform(const AssimpNodeData* node, glm::mat4 parentTransform)
+	//evaluates the pose over the flattened hierarchy in one forward pass; parents are always computed before children
+	void CalculateBoneTransforms()
 	{
-		std::string nodeName = node->name;
-		glm::mat4 nodeTransform = node->transformation;
+		const FlatHierarchy& hierarchy = m_CurrentAnimation->GetFlatHierarchy();
+		if (m_GlobalTransforms.size() < hierarchy.size())
+			m_GlobalTransforms.resize(hierarchy.size());
+		if (m_Cursors.size() < static_cast<size_t>(m_CurrentAnimation->GetBoneCount()))
+			m_Cursors.resize(m_CurrentAnimation->GetBoneCount());
 
-		Bone* Bone = m_CurrentAnimation->FindBone(nodeName);
+		EvaluatePose(*m_CurrentAnimation, m_CurrentTime, m_Cursors.data(), m_GlobalTransforms.data(),
+			m_FinalBoneMatrices.data(), static_cast<int>(m_FinalBoneMatrices.size()));
+	}
 
-		if (Bone)
+	//Pose evaluation shared by Animator and AnimationCrowd. Only reads the animation, so poses of many characters
+	//playing the same clip can be evaluated on different threads. cursors holds one KeyCursor per channel of the
+	//animation, globals one matrix per node of its flat hierarchy; palette receives paletteSize bone matrices.
+	static void EvaluatePose(const Animation& animation, float time, KeyCursor* cursors, glm::mat4* globals, glm::mat4* palette, int paletteSize)
+	{
+		const FlatHierarchy& hierarchy = animation.GetFlatHierarchy();
+		const size_t count = hierarchy.size();
+		glm::mat4 sampled;
+		for (size_t i = 0; i < count; i++)
 		{
-			Bone->Update(m_CurrentTime);
-			nodeTransform = Bone->GetLocalTransform();
-		}
+			const int channel = hierarchy.channels[i];
+			const glm::mat4* local = &hierarchy.bindLocal[i];
+			if (channel >= 0)
+			{
+				animation.GetBone(channel).Sample(time, cursors[channel], sampled);
+				local = &sampled;
+			}
 
-		glm::mat4 globalTransformation = parentTransform * nodeTransform;
+			const int parent = hierarchy.parents[i];
+			if (parent >= 0)
+				MultiplyMat4(globals[parent], *local, globals[i]);
+			else
+				globals[i] = *local;
 
-		auto boneInfoMap = m_CurrentAnimation->GetBoneIDMap();
-		if (boneInfoMap.find(nodeName) != boneInfoMap.end())
-		{
-			int index = boneInfoMap[nodeName].id;
-			glm::mat4 offset = boneInfoMap[nodeName].offset;
-			m_FinalBoneMatrices[index] = globalTransformation * offset;
+			const int boneIndex = hierarchy.bones[i];
+			if (boneIndex >= 0 && boneIndex < paletteSize)
+				MultiplyMat4(globals[i], hierarchy.boneOffsets[i], palette[boneIndex]);
 		}
-
-		for (int i = 0; i < node->childrenCount; i++)
-			CalculateBoneTransform(&node->children[i], globalTransformation);
 	}
 
-	std::vector<glm::mat4> GetFinalBoneMatrices()
+	const std::vector<glm::mat4>& GetFinalBoneMatrices() const
 	{
 		return m_FinalBoneMatrices;
 	}
 
+	BonePalette GetBonePalette() const
+	{
+		return { m_FinalBoneMatrices.data(), m_FinalBoneMatrices.size() };
+	}
+
 private:
 	std::vector<glm::mat4> m_FinalBoneMatrices;
+	std::vector<glm::mat4> m_GlobalTransforms; //per flattened node, reused every frame
+	std::vector<KeyCursor> m_Cursors;          //per channel, so animators sharing an animation don't disturb each other
 	Animation* m_CurrentAnimation;
 	float m_CurrentTime;
 	float m_DeltaTime;
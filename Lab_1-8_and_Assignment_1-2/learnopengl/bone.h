@@ -3,6 +3,7 @@
 /* Container for bone data */
 
 #include <vector>
+#include <algorithm>
 #include <assimp/scene.h>
 #include <list>
 #include <glm/glm.hpp>
@@ -28,6 +29,25 @@ struct KeyScale
 	float timeStamp;
 };
 
+//Where the last lookup of each key track of a bone landed. Kept outside the bone by anything that samples a shared
+//animation from several characters or threads (see Bone::Sample).
+struct KeyCursor
+{
+	int position = 0;
+	int rotation = 0;
+	int scale = 0;
+};
+
+//out = translate(position) * mat4(rotation) * scale(scale), without the three matrix products
+inline void ComposeTransform(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, glm::mat4& out)
+{
+	const glm::mat3 basis = glm::mat3_cast(rotation);
+	out[0] = glm::vec4(basis[0] * scale.x, 0.0f);
+	out[1] = glm::vec4(basis[1] * scale.y, 0.0f);
+	out[2] = glm::vec4(basis[2] * scale.z, 0.0f);
+	out[3] = glm::vec4(position, 1.0f);
+}
+
 class Bone
 {
 public:
@@ -71,107 +91,148 @@ public:
 			m_Scales.push_back(data);
 		}
 	}
+
+	//builds a channel from keys that didn't come from an Assimp file, e.g. a procedurally generated rig
+	Bone(const std::string& name, int ID, std::vector<KeyPosition> positions, std::vector<KeyRotation> rotations,
+		std::vector<KeyScale> scales)
+		:
+		m_Positions(std::move(positions)),
+		m_Rotations(std::move(rotations)),
+		m_Scales(std::move(scales)),
+		m_LocalTransform(1.0f),
+		m_Name(name),
+		m_ID(ID)
+	{
+		m_NumPositions = static_cast<int>(m_Positions.size());
+		m_NumRotations = static_cast<int>(m_Rotations.size());
+		m_NumScalings = static_cast<int>(m_Scales.size());
+	}
 	
 	void Update(float animationTime)
 	{
-		glm::mat4 translation = InterpolatePosition(animationTime);
-		glm::mat4 rotation = InterpolateRotation(animationTime);
-		glm::mat4 scale = InterpolateScaling(animationTime);
-		m_LocalTransform = translation * rotation * scale;
+		Sample(animationTime, m_Cursor, m_LocalTransform);
+	}
+
+	//samples the channel and composes translation * rotation * scale straight into one matrix. Const, so any number
+	//of threads can sample the same bone as long as each brings its own cursor.
+	void Sample(float animationTime, KeyCursor& cursor, glm::mat4& localTransform) const
+	{
+		ComposeTransform(InterpolatePosition(animationTime, cursor.position),
+			InterpolateRotation(animationTime, cursor.rotation),
+			InterpolateScaling(animationTime, cursor.scale), localTransform);
+	}
+
+	//samples the channel as separate translation, rotation and scale, for blending poses before they become matrices
+	void SampleTRS(float animationTime, KeyCursor& cursor, glm::vec3& position, glm::quat& rotation, glm::vec3& scale) const
+	{
+		position = InterpolatePosition(animationTime, cursor.position);
+		rotation = InterpolateRotation(animationTime, cursor.rotation);
+		scale = InterpolateScaling(animationTime, cursor.scale);
 	}
-	glm::mat4 GetLocalTransform() { return m_LocalTransform; }
+	const glm::mat4& GetLocalTransform() const { return m_LocalTransform; }
 	std::string GetBoneName() const { return m_Name; }
 	int GetBoneID() { return m_ID; }
 	
 
 
+	//index of the key at or before animationTime, clamped to [0, keys - 2] so index + 1 is always valid
 	int GetPositionIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumPositions - 1; ++index)
-		{
-			if (animationTime < m_Positions[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return FindKey(m_Positions, animationTime, m_Cursor.position);
 	}
 
 	int GetRotationIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumRotations - 1; ++index)
-		{
-			if (animationTime < m_Rotations[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return FindKey(m_Rotations, animationTime, m_Cursor.rotation);
 	}
 
 	int GetScaleIndex(float animationTime)
 	{
-		for (int index = 0; index < m_NumScalings - 1; ++index)
-		{
-			if (animationTime < m_Scales[index + 1].timeStamp)
-				return index;
-		}
-		assert(0);
+		return FindKey(m_Scales, animationTime, m_Cursor.scale);
 	}
 
 
 private:
 
-	float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
+	//Playback mostly moves forward by less than a key per frame, so the cursor from the last call (or the key after
+	//it) is almost always the answer. Anything else (looping back, seeking, big time steps) falls back to a binary
+	//search, which keeps sampling O(1) amortised for normal playback and O(log n) worst case.
+	template<typename TKey>
+	static int FindKey(const std::vector<TKey>& keys, float animationTime, int& cursor)
+	{
+		const int last = static_cast<int>(keys.size()) - 2; //last valid segment
+		if (last <= 0)
+			return 0;
+
+		if (cursor >= 0 && cursor <= last && keys[cursor].timeStamp <= animationTime)
+		{
+			if (cursor == last || animationTime < keys[cursor + 1].timeStamp)
+				return cursor;
+			if (cursor + 1 == last || animationTime < keys[cursor + 2].timeStamp)
+				return ++cursor;
+		}
+
+		//first key after animationTime; the segment starts one before it
+		auto next = std::upper_bound(keys.begin(), keys.end(), animationTime,
+			[](float time, const TKey& key) { return time < key.timeStamp; });
+		cursor = std::clamp(static_cast<int>(next - keys.begin()) - 1, 0, last);
+		return cursor;
+	}
+
+	//0 at lastTimeStamp, 1 at nextTimeStamp; clamped so times outside the keys hold the first/last value
+	static float GetScaleFactor(float lastTimeStamp, float nextTimeStamp, float animationTime)
 	{
-		float scaleFactor = 0.0f;
 		float midWayLength = animationTime - lastTimeStamp;
 		float framesDiff = nextTimeStamp - lastTimeStamp;
-		scaleFactor = midWayLength / framesDiff;
-		return scaleFactor;
+		if (framesDiff <= 0.0f)
+			return 0.0f;
+		return std::clamp(midWayLength / framesDiff, 0.0f, 1.0f);
 	}
 
-	glm::mat4 InterpolatePosition(float animationTime)
+	glm::vec3 InterpolatePosition(float animationTime, int& cursor) const
 	{
+		if (m_NumPositions == 0)
+			return glm::vec3(0.0f);
 		if (1 == m_NumPositions)
-			return glm::translate(glm::mat4(1.0f), m_Positions[0].position);
+			return m_Positions[0].position;
 
-		int p0Index = GetPositionIndex(animationTime);
+		int p0Index = FindKey(m_Positions, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Positions[p0Index].timeStamp,
 			m_Positions[p1Index].timeStamp, animationTime);
-		glm::vec3 finalPosition = glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
+		return glm::mix(m_Positions[p0Index].position, m_Positions[p1Index].position
 			, scaleFactor);
-		return glm::translate(glm::mat4(1.0f), finalPosition);
 	}
 
-	glm::mat4 InterpolateRotation(float animationTime)
+	glm::quat InterpolateRotation(float animationTime, int& cursor) const
 	{
+		if (m_NumRotations == 0)
+			return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
 		if (1 == m_NumRotations)
-		{
-			auto rotation = glm::normalize(m_Rotations[0].orientation);
-			return glm::toMat4(rotation);
-		}
+			return glm::normalize(m_Rotations[0].orientation);
 
-		int p0Index = GetRotationIndex(animationTime);
+		int p0Index = FindKey(m_Rotations, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Rotations[p0Index].timeStamp,
 			m_Rotations[p1Index].timeStamp, animationTime);
 		glm::quat finalRotation = glm::slerp(m_Rotations[p0Index].orientation, m_Rotations[p1Index].orientation
 			, scaleFactor);
-		finalRotation = glm::normalize(finalRotation);
-		return glm::toMat4(finalRotation);
-
+		return glm::normalize(finalRotation);
 	}
 
-	glm::mat4 InterpolateScaling(float animationTime)
+	glm::vec3 InterpolateScaling(float animationTime, int& cursor) const
 	{
+		if (m_NumScalings == 0)
+			return glm::vec3(1.0f);
 		if (1 == m_NumScalings)
-			return glm::scale(glm::mat4(1.0f), m_Scales[0].scale);
+			return m_Scales[0].scale;
 
-		int p0Index = GetScaleIndex(animationTime);
+		int p0Index = FindKey(m_Scales, animationTime, cursor);
 		int p1Index = p0Index + 1;
 		float scaleFactor = GetScaleFactor(m_Scales[p0Index].timeStamp,
 			m_Scales[p1Index].timeStamp, animationTime);
-		glm::vec3 finalScale = glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
+		return glm::mix(m_Scales[p0Index].scale, m_Scales[p1Index].scale
 			, scaleFactor);
-		return glm::scale(glm::mat4(1.0f), finalScale);
 	}
 
 	std::vector<KeyPosition> m_Positions;
@@ -180,6 +241,8 @@ private:
 	int m_NumPositions;
 	int m_NumRotations;
 	int m_NumScalings;
+	//segment found by the previous lookup of each key track, used by Update and Get*Index
+	KeyCursor m_Cursor;
 
 	glm::mat4 m_LocalTransform;
 	std::string m_Name;
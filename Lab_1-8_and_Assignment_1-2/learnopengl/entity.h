@@ -5,6 +5,8 @@
 #include <list> //std::list
 #include <array> //std::array
 #include <memory> //std::unique_ptr
+#include <learnopengl/render_queue.h> //RenderQueue
+#include <learnopengl/instanced_renderer.h> //InstancedRenderer
 
 class Transform
 {
@@ -342,6 +344,50 @@ Frustum createFrustumFromCamera(const Camera& cam, float aspect, float fovY, flo
 	return frustum;
 }
 
+//Picks a level of detail from the projected size of an entity's bounding sphere: its diameter as a fraction of the
+//viewport height. Level i is used below lodScreenSize[i]; the size has to cross a threshold by the hysteresis margin
+//before the level actually changes, so entities sitting near a threshold don't pop back and forth.
+struct LodSelector
+{
+	glm::vec3 cameraPosition;
+	float projectionScale; // 1 / tan(fovY / 2)
+	float lodScreenSize[MAX_MESH_LODS] = { 0.f, 0.5f, 0.25f, 0.125f, 0.0625f }; // [0] unused
+	float hysteresis = 0.15f;
+	unsigned int maxLod = MAX_MESH_LODS - 1; //0 disables LOD
+
+	LodSelector(const Camera& cam, float fovY)
+		: cameraPosition(cam.Position), projectionScale(1.f / tanf(fovY * .5f))
+	{}
+
+	float getScreenSize(const glm::vec3& center, float radius) const
+	{
+		const float distance = glm::length(center - cameraPosition);
+		if (distance <= radius)
+			return std::numeric_limits<float>::max();
+		return radius * projectionScale / distance;
+	}
+
+	unsigned int select(float screenSize, unsigned int current) const
+	{
+		unsigned int target = 0;
+		while (target < maxLod && screenSize < lodScreenSize[target + 1])
+			target++;
+
+		//only move away from the current level once past the threshold between them by the hysteresis margin
+		if (target > current)
+		{
+			while (target > current && screenSize > lodScreenSize[target] * (1.f - hysteresis))
+				target--;
+		}
+		else if (target < current)
+		{
+			while (target < current && screenSize < lodScreenSize[target + 1] * (1.f + hysteresis))
+				target++;
+		}
+		return target;
+	}
+};
+
 AABB generateAABB(const Model& model)
 {
 	glm::vec3 minAABB = glm::vec3(std::numeric_limits<float>::max());
@@ -396,6 +442,9 @@ public:
 	Model* pModel = nullptr;
 	std::unique_ptr<AABB> boundingVolume;
 
+	//Level of detail chosen during the last culling pass
+	unsigned int lod = 0;
+
 
 	// constructor, expects a filepath to a 3D model.
 	Entity(Model& model) : pModel{ &model }
@@ -437,6 +486,18 @@ public:
 		children.back()->parent = this;
 	}
 
+	//Update the level of detail from the projected size of the bounding sphere around the global AABB
+	void updateLod(const LodSelector* lodSelector)
+	{
+		if (!lodSelector)
+		{
+			lod = 0;
+			return;
+		}
+		const AABB globalAABB = getGlobalAABB();
+		lod = lodSelector->select(lodSelector->getScreenSize(globalAABB.center, glm::length(globalAABB.extents)), lod);
+	}
+
 	//Update transform if it was changed
 	void updateSelfAndChild()
 	{
@@ -466,19 +527,54 @@ public:
 	}
 
 
-	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total)
+	void drawSelfAndChild(const Frustum& frustum, Shader& ourShader, unsigned int& display, unsigned int& total, const LodSelector* lodSelector = nullptr)
 	{
 		if (boundingVolume->isOnFrustum(frustum, transform))
 		{
+			updateLod(lodSelector);
 			ourShader.setMat4("model", transform.getModelMatrix());
-			pModel->Draw(ourShader);
+			pModel->Draw(ourShader, lod);
+			display++;
+		}
+		total++;
+
+		for (auto&& child : children)
+		{
+			child->drawSelfAndChild(frustum, ourShader, display, total, lodSelector);
+		}
+	}
+
+	//Same culling as drawSelfAndChild but records the visible meshes in the queue; call queue.Submit() once all entities are collected
+	void enqueueSelfAndChild(const Frustum& frustum, Shader& ourShader, RenderQueue& queue, unsigned int& display, unsigned int& total, const LodSelector* lodSelector = nullptr)
+	{
+		if (boundingVolume->isOnFrustum(frustum, transform))
+		{
+			updateLod(lodSelector);
+			queue.AddModel(ourShader, *pModel, transform.getModelMatrix(), lod);
+			display++;
+		}
+		total++;
+
+		for (auto&& child : children)
+		{
+			child->enqueueSelfAndChild(frustum, ourShader, queue, display, total, lodSelector);
+		}
+	}
+
+	//Same culling as drawSelfAndChild but groups the visible entities by model; call renderer.Submit(instancedShader) once all entities are collected
+	void batchSelfAndChild(const Frustum& frustum, InstancedRenderer& renderer, unsigned int& display, unsigned int& total, const LodSelector* lodSelector = nullptr)
+	{
+		if (boundingVolume->isOnFrustum(frustum, transform))
+		{
+			updateLod(lodSelector);
+			renderer.Add(*pModel, transform.getModelMatrix(), lod);
 			display++;
 		}
 		total++;
 
 		for (auto&& child : children)
 		{
-			child->drawSelfAndChild(frustum, ourShader, display, total);
+			child->batchSelfAndChild(frustum, renderer, display, total, lodSelector);
 		}
 	}
 };
@@ -0,0 +1,171 @@
+#ifndef INSTANCED_RENDERER_H
+#define INSTANCED_RENDERER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+// first attribute location of the per-instance mat4 (occupies 7, 8, 9 and 10, after the bone weights at 6)
+#define INSTANCE_MATRIX_LOCATION 7
+
+// Per-frame counters filled in by InstancedRenderer::Submit.
+struct InstanceStats
+{
+    unsigned int drawCalls = 0;
+    unsigned int batches   = 0; // unique models drawn
+    unsigned int instances = 0;
+    size_t       triangles = 0;
+};
+
+// Groups visible entities by the model they reference and draws each mesh once with glDrawElementsInstanced.
+// The model matrices of every batch are packed into a single per-frame instance buffer.
+// Use together with an instanced vertex shader that reads the model matrix from location
+// INSTANCE_MATRIX_LOCATION instead of the "model" uniform (see shaders/1.model_loading_instanced.vs).
+class InstancedRenderer
+{
+public:
+    InstanceStats stats;
+
+    InstancedRenderer()
+    {
+        glGenBuffers(1, &instanceVBO);
+    }
+
+    ~InstancedRenderer()
+    {
+        glDeleteBuffers(1, &instanceVBO);
+    }
+
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+
+    // record one instance of a model at a level of detail (works with both model.h and model_animation.h)
+    template<typename TModel>
+    void Add(TModel& model, const glm::mat4& modelMatrix, unsigned int lod = 0)
+    {
+        std::vector<Mesh>* key = &model.meshes;
+        auto it = batchIndex.find(key);
+        if (it == batchIndex.end())
+        {
+            it = batchIndex.emplace(key, batchesUsed).first;
+            if (batches.size() == batchesUsed)
+                batches.emplace_back();
+            batches[batchesUsed].meshes = key;
+            for (std::vector<glm::mat4>& matrices : batches[batchesUsed].matrices)
+                matrices.clear();
+            batchesUsed++;
+        }
+        batches[it->second].matrices[std::min(lod, MAX_MESH_LODS - 1u)].push_back(modelMatrix);
+    }
+
+    // uploads all instance matrices in one go and issues one instanced draw per unique mesh, then resets for the next frame
+    void Submit(Shader& shader)
+    {
+        stats = InstanceStats();
+
+        // pack every batch (and level of detail) contiguously into the staging array
+        staging.clear();
+        for (size_t b = 0; b < batchesUsed; b++)
+            for (const std::vector<glm::mat4>& matrices : batches[b].matrices)
+                staging.insert(staging.end(), matrices.begin(), matrices.end());
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        if (staging.size() > capacity)
+            capacity = staging.size() + staging.size() / 2;
+        // (re)allocating every frame orphans the old storage so we don't stall on draws still reading last frame's matrices
+        glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(glm::mat4), NULL, GL_STREAM_DRAW);
+        if (!staging.empty())
+            glBufferSubData(GL_ARRAY_BUFFER, 0, staging.size() * sizeof(glm::mat4), staging.data());
+
+        shader.use();
+        size_t firstInstance = 0;
+        for (size_t b = 0; b < batchesUsed; b++)
+        {
+            const Batch& batch = batches[b];
+            for (unsigned int lod = 0; lod < MAX_MESH_LODS; lod++)
+            {
+                const GLsizei count = static_cast<GLsizei>(batch.matrices[lod].size());
+                if (count == 0)
+                    continue;
+                for (Mesh& mesh : *batch.meshes)
+                {
+                    const MeshLod& level = mesh.Lod(lod);
+                    bindTextures(shader, mesh);
+                    glBindVertexArray(mesh.VAO);
+                    setupInstanceAttributes(firstInstance * sizeof(glm::mat4));
+                    glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(unsigned int)), count);
+                    clearInstanceAttributes();
+                    stats.drawCalls++;
+                    stats.triangles += size_t(level.indexCount / 3) * count;
+                }
+                firstInstance += count;
+                stats.instances += count;
+            }
+            stats.batches++;
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glActiveTexture(GL_TEXTURE0);
+
+        batchIndex.clear();
+        batchesUsed = 0;
+    }
+
+private:
+    struct Batch
+    {
+        std::vector<Mesh>*     meshes = nullptr;
+        std::vector<glm::mat4> matrices[MAX_MESH_LODS]; // per level of detail
+    };
+
+    unsigned int instanceVBO = 0;
+    size_t capacity = 0; // in matrices
+
+    // batches are reused across frames so their matrix vectors keep their allocations
+    std::vector<Batch> batches;
+    size_t batchesUsed = 0;
+    std::unordered_map<const std::vector<Mesh>*, size_t> batchIndex;
+    std::vector<glm::mat4> staging;
+
+    void bindTextures(Shader& shader, const Mesh& mesh)
+    {
+        for (unsigned int i = 0; i < mesh.textures.size(); i++)
+        {
+            glActiveTexture(GL_TEXTURE0 + i);
+            shader.setInt(mesh.samplerNames[i], i);
+            glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+        }
+    }
+
+    // points the mat4 attribute (4 vec4 columns) of the bound VAO at this batch's slice of the instance buffer
+    void setupInstanceAttributes(size_t byteOffset)
+    {
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            const unsigned int location = INSTANCE_MATRIX_LOCATION + column;
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(byteOffset + column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    // the VAO is the mesh's own, shared with Mesh::Draw and AnimationCrowd::Draw, so the instance attributes are switched
+    // off again right after the draw instead of being left pointing into this renderer's buffer
+    void clearInstanceAttributes()
+    {
+        for (unsigned int column = 0; column < 4; column++)
+        {
+            const unsigned int location = INSTANCE_MATRIX_LOCATION + column;
+            glVertexAttribDivisor(location, 0);
+            glDisableVertexAttribArray(location);
+        }
+    }
+};
+#endif
@@ -5,9 +5,13 @@
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
 
 #include <learnopengl/shader.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
 #include <string>
 #include <vector>
 using namespace std;
@@ -31,6 +35,51 @@ struct Vertex {
 	float m_Weights[MAX_BONE_INFLUENCE];
 };
 
+// GPU-side vertex formats a Mesh can be uploaded with. The attribute locations stay the same for every layout and
+// normalized/half-float attributes arrive in the shader as plain floats, so existing shaders work unchanged.
+enum VertexLayout {
+    // the Vertex struct as is, all floats/ints
+    VERTEX_LAYOUT_FULL,
+    // no bone data; normal/tangent/bitangent as snorm 10-10-10-2, uvs as half floats
+    VERTEX_LAYOUT_STATIC_PACKED,
+    // VERTEX_LAYOUT_STATIC_PACKED plus int8 bone ids (-1 still means unused) and unorm8 weights
+    VERTEX_LAYOUT_SKINNED_PACKED
+};
+
+struct PackedStaticVertex {
+    glm::vec3 Position;
+    uint32_t  Normal;    // GL_INT_2_10_10_10_REV
+    uint32_t  TexCoords; // 2 x GL_HALF_FLOAT
+    uint32_t  Tangent;   // GL_INT_2_10_10_10_REV
+    uint32_t  Bitangent; // GL_INT_2_10_10_10_REV
+};
+
+struct PackedSkinnedVertex {
+    glm::vec3 Position;
+    uint32_t  Normal;
+    uint32_t  TexCoords;
+    uint32_t  Tangent;
+    uint32_t  Bitangent;
+    int8_t    BoneIDs[MAX_BONE_INFLUENCE]; // GL_BYTE, so the -1 "no bone" marker survives (ids up to 127)
+    uint32_t  Weights;                     // 4 x GL_UNSIGNED_BYTE normalized
+};
+
+// most levels of detail a mesh can have, the full resolution level 0 included
+#define MAX_MESH_LODS 5
+
+// one level of detail: a range of the mesh's element buffer. All levels share the vertex buffer.
+struct MeshLod {
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    float        error; // geometric error relative to the mesh's extent (0 for the full resolution level)
+};
+
+// the simplified levels 1.. of a mesh; levels index into indices, which is appended after the full index list on upload
+struct MeshLodChain {
+    vector<unsigned int> indices;
+    vector<MeshLod>      levels;
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -44,50 +93,61 @@ public:
     vector<unsigned int> indices;
     vector<Texture>      textures;
     unsigned int VAO;
+    // format the vertices were uploaded with and the resulting size in video memory
+    VertexLayout layout;
+    size_t       vertexBytes = 0;
+    size_t       indexBytes  = 0;
+
+    // simplified levels and every level's range in the element buffer (lods[0] is the full mesh)
+    MeshLodChain    lodChain;
+    vector<MeshLod> lods;
 
     // constructor
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexLayout layout = VERTEX_LAYOUT_FULL, MeshLodChain lodChain = MeshLodChain())
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->layout = layout;
+        this->lodChain = std::move(lodChain);
+
+        lods.push_back({ 0, static_cast<unsigned int>(this->indices.size()), 0.0f });
+        for (const MeshLod& level : this->lodChain.levels)
+            lods.push_back({ static_cast<unsigned int>(this->indices.size()) + level.firstIndex, level.indexCount, level.error });
 
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
+        setupMaterial();
+    }
+
+    // sampler uniform name for each entry in textures (e.g. "texture_diffuse1"), built once so drawing doesn't concatenate strings
+    vector<string>       samplerNames;
+    // 64-bit hash of the texture ids and their sampler names, used by the render queue to group meshes sharing a material
+    uint64_t             materialKey = 0;
+
+    // the level actually drawn when lod is requested (meshes too small to simplify only have level 0)
+    const MeshLod& Lod(unsigned int lod) const
+    {
+        return lods[std::min<size_t>(lod, lods.size() - 1)];
     }
 
     // render the mesh
-    void Draw(Shader &shader) 
+    void Draw(Shader &shader, unsigned int lod = 0) 
     {
         // bind appropriate textures
-        unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
-            // retrieve texture number (the N in diffuse_textureN)
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to string
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to string
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to string
-
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            shader.setInt(samplerNames[i], i);
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
         
         // draw mesh
+        const MeshLod& level = Lod(lod);
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, static_cast<unsigned int>(indices.size()), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(unsigned int)));
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
@@ -98,9 +158,48 @@ private:
     // render data 
     unsigned int VBO, EBO;
 
+    // resolves the sampler names (the N in diffuse_textureN) and the material key once per mesh
+    void setupMaterial()
+    {
+        unsigned int diffuseNr  = 1;
+        unsigned int specularNr = 1;
+        unsigned int normalNr   = 1;
+        unsigned int heightNr   = 1;
+        samplerNames.clear();
+        materialKey = 14695981039346656037ull; // FNV-1a offset basis
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            string number;
+            const string& name = textures[i].type;
+            if(name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if(name == "texture_specular")
+                number = std::to_string(specularNr++); // transfer unsigned int to string
+            else if(name == "texture_normal")
+                number = std::to_string(normalNr++); // transfer unsigned int to string
+            else if(name == "texture_height")
+                number = std::to_string(heightNr++); // transfer unsigned int to string
+            samplerNames.push_back(name + number);
+
+            // the sampler a texture binds to is part of the material too, not just its id
+            materialKey = (materialKey ^ textures[i].id) * 1099511628211ull; // FNV-1a prime
+            for (char c : samplerNames.back())
+                materialKey = (materialKey ^ (unsigned char)c) * 1099511628211ull;
+        }
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        // the packed skinned format stores bone ids in a signed byte; fall back to full precision for bigger rigs
+        if (layout == VERTEX_LAYOUT_SKINNED_PACKED)
+        {
+            for (const Vertex& vertex : vertices)
+                for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+                    if (vertex.m_BoneIDs[i] > 127)
+                        layout = VERTEX_LAYOUT_FULL;
+        }
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -109,13 +208,35 @@ private:
         glBindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        if (layout == VERTEX_LAYOUT_STATIC_PACKED)
+            uploadStaticPacked();
+        else if (layout == VERTEX_LAYOUT_SKINNED_PACKED)
+            uploadSkinnedPacked();
+        else
+            uploadFull();
+
+        // the full index list followed by the simplified levels
+        const size_t fullBytes = indices.size() * sizeof(unsigned int);
+        indexBytes = fullBytes + lodChain.indices.size() * sizeof(unsigned int);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        if (lodChain.indices.empty())
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, &indices[0], GL_STATIC_DRAW);
+        else
+        {
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, NULL, GL_STATIC_DRAW);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, fullBytes, &indices[0]);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, fullBytes, indexBytes - fullBytes, &lodChain.indices[0]);
+        }
+        glBindVertexArray(0);
+    }
+
+    void uploadFull()
+    {
         // A great thing about structs is that their memory layout is sequential for all its items.
         // The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
         // again translates to 3/2 floats which translates to a byte array.
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        vertexBytes = vertices.size() * sizeof(Vertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, &vertices[0], GL_STATIC_DRAW);  
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -140,7 +261,104 @@ private:
 		// weights
 		glEnableVertexAttribArray(6);
 		glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, m_Weights));
-        glBindVertexArray(0);
+    }
+
+    static uint32_t packDirection(const glm::vec3& v)
+    {
+        return glm::packSnorm3x10_1x2(glm::vec4(glm::clamp(v, -1.0f, 1.0f), 0.0f));
+    }
+
+    template<typename TPacked>
+    static void packCommon(TPacked& out, const Vertex& in)
+    {
+        out.Position  = in.Position;
+        out.Normal    = packDirection(in.Normal);
+        out.TexCoords = glm::packHalf2x16(in.TexCoords);
+        out.Tangent   = packDirection(in.Tangent);
+        out.Bitangent = packDirection(in.Bitangent);
+    }
+
+    // position, normal, uv, tangent and bitangent attributes shared by both packed layouts
+    template<typename TPacked>
+    static void setCommonAttributes()
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TPacked), (void*)offsetof(TPacked, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(TPacked), (void*)offsetof(TPacked, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(TPacked), (void*)offsetof(TPacked, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(TPacked), (void*)offsetof(TPacked, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(TPacked), (void*)offsetof(TPacked, Bitangent));
+    }
+
+    void uploadStaticPacked()
+    {
+        vector<PackedStaticVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+            packCommon(packed[i], vertices[i]);
+
+        vertexBytes = packed.size() * sizeof(PackedStaticVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, &packed[0], GL_STATIC_DRAW);
+        setCommonAttributes<PackedStaticVertex>();
+    }
+
+    void uploadSkinnedPacked()
+    {
+        vector<PackedSkinnedVertex> packed(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            packCommon(packed[i], vertices[i]);
+            glm::vec4 weights;
+            for (int j = 0; j < MAX_BONE_INFLUENCE; j++)
+            {
+                packed[i].BoneIDs[j] = static_cast<int8_t>(vertices[i].m_BoneIDs[j]);
+                weights[j] = vertices[i].m_Weights[j];
+            }
+            packed[i].Weights = glm::packUnorm4x8(weights);
+        }
+
+        vertexBytes = packed.size() * sizeof(PackedSkinnedVertex);
+        glBufferData(GL_ARRAY_BUFFER, vertexBytes, &packed[0], GL_STATIC_DRAW);
+        setCommonAttributes<PackedSkinnedVertex>();
+        // ids
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 4, GL_BYTE, sizeof(PackedSkinnedVertex), (void*)offsetof(PackedSkinnedVertex, BoneIDs));
+        // weights
+        glEnableVertexAttribArray(6);
+        glVertexAttribPointer(6, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PackedSkinnedVertex), (void*)offsetof(PackedSkinnedVertex, Weights));
     }
 };
+
+// vertex/index memory of a set of meshes, compared to uploading everything with the full Vertex format
+struct VertexMemoryStats {
+    size_t vertexCount = 0;
+    size_t fullBytes   = 0;
+    size_t gpuBytes    = 0;
+};
+
+inline VertexMemoryStats MeasureVertexMemory(const vector<Mesh>& meshes)
+{
+    VertexMemoryStats stats;
+    for (const Mesh& mesh : meshes)
+    {
+        stats.vertexCount += mesh.vertices.size();
+        stats.fullBytes   += mesh.vertices.size() * sizeof(Vertex) + mesh.indexBytes;
+        stats.gpuBytes    += mesh.vertexBytes + mesh.indexBytes;
+    }
+    return stats;
+}
+
+inline void PrintVertexMemory(const vector<Mesh>& meshes, const string& name)
+{
+    VertexMemoryStats stats = MeasureVertexMemory(meshes);
+    if (stats.vertexCount == 0)
+        return;
+    const double saved = stats.fullBytes ? 100.0 * (1.0 - double(stats.gpuBytes) / double(stats.fullBytes)) : 0.0;
+    std::cout << "MODEL::VERTEX_MEMORY " << name << ": " << stats.vertexCount << " vertices, "
+              << stats.gpuBytes / 1024 << " KiB in VRAM vs " << stats.fullBytes / 1024 << " KiB unpacked ("
+              << saved << "% less memory and vertex fetch bandwidth)" << std::endl;
+}
 #endif
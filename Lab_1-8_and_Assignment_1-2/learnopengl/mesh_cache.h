@@ -0,0 +1,355 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/animdata.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary cache of an imported model, written next to the source file as "<source>.meshcache".
+// It stores the processed vertex/index arrays, the texture references of every mesh and (for animated models) the
+// bone info map, so a warm start skips Assimp entirely. The cache is only used when its version, the source file's
+// modification time, the Assimp import flags, the source path and sizeof(Vertex) all match.
+//
+// Layout (little endian, no padding):
+//   MeshCacheHeader, source path
+//   per mesh: vertexCount, indexCount, textureCount (uint32),
+//             per texture: type length + type, path length + path,
+//             vertices (vertexCount * sizeof(Vertex)), indices (indexCount * uint32),
+//             lodLevelCount, lodIndexCount (uint32), levels (lodLevelCount * MeshLod), lod indices (lodIndexCount * uint32)
+//   boneCounter (int32), bone map entries: name length + name, id (int32), offset (16 floats)
+
+// 2: vertices and indices are stored after MeshOptimizer, so a warm start gets the optimised order for free
+// 3: meshes carry their simplified LOD chain
+#define MESH_CACHE_VERSION 3
+
+struct MeshCacheHeader
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t importFlags;
+    int64_t  sourceTime;
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t boneMapSize;
+    uint32_t pathLength;
+};
+
+struct CachedTexture
+{
+    string type;
+    string path;
+};
+
+struct CachedMesh
+{
+    vector<Vertex>        vertices;
+    vector<unsigned int>  indices;
+    vector<CachedTexture> textures;
+    MeshLodChain          lodChain;
+};
+
+struct MeshCacheData
+{
+    vector<CachedMesh>    meshes;
+    map<string, BoneInfo> boneInfoMap;
+    int                   boneCounter = 0;
+};
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+    const char* data = nullptr;
+    size_t      size = 0;
+
+    MappedFile(const string& path)
+    {
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+            return;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping)
+            return;
+        data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        size = data ? static_cast<size_t>(fileSize.QuadPart) : 0;
+#else
+        fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+            return;
+        void* mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+            return;
+        data = static_cast<const char*>(mapped);
+        size = static_cast<size_t>(info.st_size);
+#endif
+    }
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+        if (data)
+            UnmapViewOfFile(data);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (data)
+            munmap(const_cast<char*>(data), size);
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+private:
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+class MeshCache
+{
+public:
+    static string CachePath(const string& sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    // fills data from the cache of sourcePath; returns false if there is no valid cache for these import flags
+    static bool Load(const string& sourcePath, unsigned int importFlags, MeshCacheData& data)
+    {
+        MappedFile file(CachePath(sourcePath));
+        if (!file.data)
+            return false;
+
+        Reader in{ file.data, file.data + file.size };
+        MeshCacheHeader header;
+        if (!in.read(&header, sizeof(header)) || !headerMatches(header, sourcePath, importFlags))
+            return false;
+        string path;
+        if (!in.readString(path, header.pathLength) || path != sourcePath)
+            return false;
+
+        // a mesh is at least its five counts
+        if (!in.has(header.meshCount, 5 * sizeof(uint32_t)))
+            return false;
+        data.meshes.resize(header.meshCount);
+        for (CachedMesh& mesh : data.meshes)
+        {
+            uint32_t vertexCount = 0, indexCount = 0, textureCount = 0;
+            if (!in.read(&vertexCount, 4) || !in.read(&indexCount, 4) || !in.read(&textureCount, 4))
+                return false;
+            // a texture is at least its two string lengths
+            if (!in.has(textureCount, 2 * sizeof(uint32_t)))
+                return false;
+            mesh.textures.resize(textureCount);
+            for (CachedTexture& texture : mesh.textures)
+            {
+                if (!in.readSizedString(texture.type) || !in.readSizedString(texture.path))
+                    return false;
+            }
+            // one memcpy straight out of the mapping per array
+            if (!in.has(size_t(vertexCount) * sizeof(Vertex) + size_t(indexCount) * sizeof(unsigned int), 1))
+                return false;
+            mesh.vertices.resize(vertexCount);
+            mesh.indices.resize(indexCount);
+            if (!in.read(mesh.vertices.data(), vertexCount * sizeof(Vertex)) || !in.read(mesh.indices.data(), indexCount * sizeof(unsigned int)))
+                return false;
+            // an index past the vertex array would make the GPU read outside the VBO
+            if (!indicesInRange(mesh.indices, vertexCount))
+                return false;
+
+            uint32_t lodLevelCount = 0, lodIndexCount = 0;
+            if (!in.read(&lodLevelCount, 4) || !in.read(&lodIndexCount, 4) || lodLevelCount >= MAX_MESH_LODS)
+                return false;
+            if (!in.has(size_t(lodLevelCount) * sizeof(MeshLod) + size_t(lodIndexCount) * sizeof(unsigned int), 1))
+                return false;
+            mesh.lodChain.levels.resize(lodLevelCount);
+            mesh.lodChain.indices.resize(lodIndexCount);
+            if (!in.read(mesh.lodChain.levels.data(), lodLevelCount * sizeof(MeshLod)) || !in.read(mesh.lodChain.indices.data(), lodIndexCount * sizeof(unsigned int)))
+                return false;
+            for (const MeshLod& level : mesh.lodChain.levels)
+                if (size_t(level.firstIndex) + level.indexCount > lodIndexCount)
+                    return false;
+            if (!indicesInRange(mesh.lodChain.indices, vertexCount))
+                return false;
+        }
+
+        int32_t boneCounter = 0;
+        if (!in.read(&boneCounter, 4))
+            return false;
+        data.boneCounter = boneCounter;
+        for (uint32_t i = 0; i < header.boneMapSize; i++)
+        {
+            string name;
+            int32_t id = 0;
+            BoneInfo info;
+            if (!in.readSizedString(name) || !in.read(&id, 4) || !in.read(&info.offset, sizeof(glm::mat4)))
+                return false;
+            info.id = id;
+            data.boneInfoMap[name] = info;
+        }
+        return true;
+    }
+
+    // writes the processed meshes (and bone map, if any) of sourcePath to its cache file
+    static bool Save(const string& sourcePath, unsigned int importFlags, const vector<Mesh>& meshes,
+                     const map<string, BoneInfo>& boneInfoMap = map<string, BoneInfo>(), int boneCounter = 0)
+    {
+        FILE* file = fopen(CachePath(sourcePath).c_str(), "wb");
+        if (!file)
+            return false;
+
+        MeshCacheHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, "LOGLMSH", 8);
+        header.version = MESH_CACHE_VERSION;
+        header.importFlags = importFlags;
+        header.sourceTime = SourceTime(sourcePath);
+        header.vertexSize = sizeof(Vertex);
+        header.meshCount = static_cast<uint32_t>(meshes.size());
+        header.boneMapSize = static_cast<uint32_t>(boneInfoMap.size());
+        header.pathLength = static_cast<uint32_t>(sourcePath.size());
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(sourcePath.data(), 1, sourcePath.size(), file);
+
+        for (const Mesh& mesh : meshes)
+        {
+            const uint32_t counts[3] = { static_cast<uint32_t>(mesh.vertices.size()), static_cast<uint32_t>(mesh.indices.size()), static_cast<uint32_t>(mesh.textures.size()) };
+            fwrite(counts, 4, 3, file);
+            for (const Texture& texture : mesh.textures)
+            {
+                writeSizedString(file, texture.type);
+                writeSizedString(file, texture.path);
+            }
+            fwrite(mesh.vertices.data(), sizeof(Vertex), mesh.vertices.size(), file);
+            fwrite(mesh.indices.data(), sizeof(unsigned int), mesh.indices.size(), file);
+
+            const uint32_t lodCounts[2] = { static_cast<uint32_t>(mesh.lodChain.levels.size()), static_cast<uint32_t>(mesh.lodChain.indices.size()) };
+            fwrite(lodCounts, 4, 2, file);
+            fwrite(mesh.lodChain.levels.data(), sizeof(MeshLod), mesh.lodChain.levels.size(), file);
+            fwrite(mesh.lodChain.indices.data(), sizeof(unsigned int), mesh.lodChain.indices.size(), file);
+        }
+
+        const int32_t counter = boneCounter;
+        fwrite(&counter, 4, 1, file);
+        for (const auto& bone : boneInfoMap)
+        {
+            writeSizedString(file, bone.first);
+            const int32_t id = bone.second.id;
+            fwrite(&id, 4, 1, file);
+            fwrite(&bone.second.offset, sizeof(glm::mat4), 1, file);
+        }
+
+        const bool ok = ferror(file) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    // modification time of the source file, 0 if it can't be read
+    static int64_t SourceTime(const string& sourcePath)
+    {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(sourcePath, error);
+        if (error)
+            return 0;
+        return static_cast<int64_t>(time.time_since_epoch().count());
+    }
+
+private:
+    struct Reader
+    {
+        const char* cursor;
+        const char* end;
+
+        bool read(void* dest, size_t bytes)
+        {
+            if (size_t(end - cursor) < bytes)
+                return false;
+            if (bytes)
+                memcpy(dest, cursor, bytes);
+            cursor += bytes;
+            return true;
+        }
+
+        // whether count elements of elementSize bytes each fit in what is left, so counts read from a corrupt file
+        // are rejected before anything is allocated for them
+        bool has(size_t count, size_t elementSize) const
+        {
+            return count <= size_t(end - cursor) / elementSize;
+        }
+
+        bool readString(string& dest, uint32_t length)
+        {
+            if (size_t(end - cursor) < length)
+                return false;
+            dest.assign(cursor, length);
+            cursor += length;
+            return true;
+        }
+
+        bool readSizedString(string& dest)
+        {
+            uint32_t length = 0;
+            return read(&length, 4) && readString(dest, length);
+        }
+    };
+
+    static bool headerMatches(const MeshCacheHeader& header, const string& sourcePath, unsigned int importFlags)
+    {
+        return memcmp(header.magic, "LOGLMSH", 8) == 0 &&
+               header.version == MESH_CACHE_VERSION &&
+               header.importFlags == importFlags &&
+               header.vertexSize == sizeof(Vertex) &&
+               header.sourceTime == SourceTime(sourcePath) &&
+               header.pathLength == sourcePath.size();
+    }
+
+    static bool indicesInRange(const vector<unsigned int>& indices, uint32_t vertexCount)
+    {
+        for (unsigned int index : indices)
+            if (index >= vertexCount)
+                return false;
+        return true;
+    }
+
+    static void writeSizedString(FILE* file, const string& value)
+    {
+        const uint32_t length = static_cast<uint32_t>(value.size());
+        fwrite(&length, 4, 1, file);
+        fwrite(value.data(), 1, value.size(), file);
+    }
+};
+#endif
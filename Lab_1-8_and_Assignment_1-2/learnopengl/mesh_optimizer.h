@@ -0,0 +1,338 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// size of the FIFO post-transform cache the triangle order is optimised for and statistics are simulated with
+#define VERTEX_CACHE_SIZE 16
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache of VERTEX_CACHE_SIZE entries.
+// ACMR = vertex shader invocations per triangle (0.5 is ideal on a regular grid, 3 is worst);
+// ATVR = invocations per referenced vertex (1 is ideal).
+struct VertexCacheStats
+{
+    size_t triangles = 0;
+    size_t vertices  = 0; // distinct vertices referenced
+    size_t misses    = 0;
+
+    float ACMR() const { return triangles ? float(misses) / float(triangles) : 0.0f; }
+    float ATVR() const { return vertices ? float(misses) / float(vertices) : 0.0f; }
+
+    VertexCacheStats& operator+=(const VertexCacheStats& other)
+    {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        misses += other.misses;
+        return *this;
+    }
+};
+
+struct MeshOptimizeStats
+{
+    VertexCacheStats before;
+    VertexCacheStats after;
+
+    MeshOptimizeStats& operator+=(const MeshOptimizeStats& other)
+    {
+        before += other.before;
+        after += other.after;
+        return *this;
+    }
+};
+
+// Load-time optimisation of triangle lists, run on the CPU arrays before Mesh::setupMesh uploads them:
+//   1. Tipsify (Sander et al. 2007) reorders triangles for the post-transform vertex cache,
+//   2. the resulting clusters are sorted front to back from the outside in to reduce overdraw,
+//   3. vertices are reordered by first use so vertex fetch walks memory linearly (unused vertices are dropped).
+// Everything here is plain CPU work, so it is safe to call from worker threads.
+class MeshOptimizer
+{
+public:
+    // runs all three passes in place and returns the cache statistics before and after
+    static MeshOptimizeStats Optimize(vector<Vertex>& vertices, vector<unsigned int>& indices)
+    {
+        MeshOptimizeStats stats;
+        stats.before = AnalyzeVertexCache(indices, vertices.size());
+        if (indices.empty() || indices.size() % 3 != 0)
+        {
+            stats.after = stats.before;
+            return stats;
+        }
+
+        vector<size_t> clusters;
+        indices = OptimizeVertexCache(indices, vertices.size(), clusters);
+        indices = OptimizeOverdraw(indices, vertices, clusters);
+        OptimizeVertexFetch(vertices, indices);
+
+        stats.after = AnalyzeVertexCache(indices, vertices.size());
+        return stats;
+    }
+
+    static VertexCacheStats AnalyzeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        VertexCacheStats stats;
+        stats.triangles = indices.size() / 3;
+
+        // a vertex is in the FIFO if fewer than cacheSize misses happened since it was inserted
+        vector<size_t> insertedAt(vertexCount, 0);
+        for (unsigned int index : indices)
+        {
+            if (insertedAt[index] == 0)
+                stats.vertices++;
+            if (insertedAt[index] == 0 || stats.misses - insertedAt[index] >= cacheSize)
+            {
+                stats.misses++;
+                insertedAt[index] = stats.misses;
+            }
+        }
+        return stats;
+    }
+
+    // Tipsify: fans around the most recently used vertex that will still be in the cache. Returns the reordered index
+    // list; clusters receives the first triangle of every run that started from a dead end (always including 0).
+    static vector<unsigned int> OptimizeVertexCache(const vector<unsigned int>& indices, size_t vertexCount, vector<size_t>& clusters, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        clusters.clear();
+
+        // vertex -> triangle adjacency in compressed rows
+        vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (unsigned int index : indices)
+            liveTriangles[index]++;
+        vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+        vector<unsigned int> adjacency(indices.size());
+        vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for (size_t i = 0; i < indices.size(); i++)
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+
+        vector<unsigned int> cacheTime(vertexCount, 0);
+        vector<char> emitted(triangleCount, 0);
+        vector<unsigned int> deadEnd; // recently referenced vertices, used to restart after a dead end
+        vector<unsigned int> candidates;
+        deadEnd.reserve(indices.size());
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+
+        unsigned int timestamp = cacheSize + 1;
+        size_t cursor = 0;                         // next vertex to try when the dead-end stack runs dry
+        long long fanning = skipDeadEnd(liveTriangles, deadEnd, cursor);
+        while (fanning >= 0)
+        {
+            if (clusters.empty())
+                clusters.push_back(0);
+
+            // emit every remaining triangle around the fanning vertex
+            candidates.clear();
+            for (size_t a = adjacencyOffset[fanning]; a < adjacencyOffset[fanning + 1]; a++)
+            {
+                const unsigned int triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    const unsigned int v = indices[triangle * 3 + k];
+                    result.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (timestamp - cacheTime[v] > cacheSize)
+                        cacheTime[v] = timestamp++;
+                }
+                emitted[triangle] = 1;
+            }
+
+            // next fanning vertex: the candidate that is still cached after its own fan is emitted and is oldest
+            long long next = -1;
+            int best = -1;
+            for (unsigned int v : candidates)
+            {
+                if (liveTriangles[v] == 0)
+                    continue;
+                int priority = 0;
+                if (timestamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+                    priority = int(timestamp - cacheTime[v]);
+                if (priority > best)
+                {
+                    best = priority;
+                    next = v;
+                }
+            }
+            if (next < 0)
+            {
+                next = skipDeadEnd(liveTriangles, deadEnd, cursor);
+                if (next >= 0)
+                    clusters.push_back(result.size() / 3);
+            }
+            fanning = next;
+        }
+        return result;
+    }
+
+    // sorts the clusters of a cache-optimised index list so outward facing, outer clusters are drawn first. Clusters
+    // that are long enough are split further at points where that keeps the cache efficiency within threshold.
+    static vector<unsigned int> OptimizeOverdraw(const vector<unsigned int>& indices, const vector<Vertex>& vertices, const vector<size_t>& hardClusters, float threshold = 1.05f)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0)
+            return indices;
+
+        vector<size_t> clusters = splitClusters(indices, vertices.size(), hardClusters, threshold);
+
+        // mesh centroid, area weighted
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            float area;
+            glm::vec3 normal;
+            const glm::vec3 centroid = triangleCentroid(indices, vertices, t, area, normal);
+            meshCentroid += centroid * area;
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCentroid /= meshArea;
+
+        struct Cluster
+        {
+            size_t begin, end;
+            float  sortKey;
+        };
+        vector<Cluster> sorted;
+        sorted.reserve(clusters.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+            Cluster cluster;
+            cluster.begin = clusters[c];
+            cluster.end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = cluster.begin; t < cluster.end; t++)
+            {
+                float triangleArea = 0.0f;
+                glm::vec3 triangleNormal;
+                centroid += triangleCentroid(indices, vertices, t, triangleArea, triangleNormal) * triangleArea;
+                normal += triangleNormal;
+                area += triangleArea;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            const float normalLength = glm::length(normal);
+            // how far the cluster faces away from the mesh centre: those are likely to occlude the rest
+            cluster.sortKey = normalLength > 0.0f ? glm::dot(centroid - meshCentroid, normal / normalLength) : 0.0f;
+            sorted.push_back(cluster);
+        }
+        std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+        vector<unsigned int> result;
+        result.reserve(indices.size());
+        for (const Cluster& cluster : sorted)
+            result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+        return result;
+    }
+
+    // reorders vertices by first use in the index list and rewrites the indices; vertices no triangle uses are removed
+    static void OptimizeVertexFetch(vector<Vertex>& vertices, vector<unsigned int>& indices)
+    {
+        const unsigned int unused = ~0u;
+        vector<unsigned int> remap(vertices.size(), unused);
+        vector<Vertex> reordered;
+        reordered.reserve(vertices.size());
+        for (unsigned int& index : indices)
+        {
+            if (remap[index] == unused)
+            {
+                remap[index] = static_cast<unsigned int>(reordered.size());
+                reordered.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices.swap(reordered);
+    }
+
+private:
+    static long long skipDeadEnd(const vector<unsigned int>& liveTriangles, vector<unsigned int>& deadEnd, size_t& cursor)
+    {
+        while (!deadEnd.empty())
+        {
+            const unsigned int v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0)
+                return v;
+        }
+        for (; cursor < liveTriangles.size(); cursor++)
+        {
+            if (liveTriangles[cursor] > 0)
+                return static_cast<long long>(cursor);
+        }
+        return -1;
+    }
+
+    // splits every hard cluster where the triangles so far already reach (threshold x) the cluster's own ACMR
+    static vector<size_t> splitClusters(const vector<unsigned int>& indices, size_t vertexCount, const vector<size_t>& hardClusters, float threshold)
+    {
+        const size_t triangleCount = indices.size() / 3;
+        vector<size_t> insertedAt(vertexCount, 0);
+        size_t misses = 0;
+
+        // simulates triangles [begin, end) on a cold cache and returns the misses of the last cluster; with splits set,
+        // a new cluster starts whenever the running ACMR has dropped to targetACMR
+        auto simulate = [&](size_t begin, size_t end, float targetACMR, vector<size_t>* splits)
+        {
+            misses += VERTEX_CACHE_SIZE + 1; // invalidates everything cached so far
+            size_t start = begin, clusterMisses = 0;
+            for (size_t t = begin; t < end; t++)
+            {
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    const unsigned int v = indices[t * 3 + k];
+                    if (insertedAt[v] == 0 || misses - insertedAt[v] >= VERTEX_CACHE_SIZE)
+                    {
+                        misses++;
+                        clusterMisses++;
+                        insertedAt[v] = misses;
+                    }
+                }
+                if (splits && t + 1 < end && float(clusterMisses) / float(t + 1 - start) <= targetACMR)
+                {
+                    splits->push_back(t + 1);
+                    start = t + 1;
+                    clusterMisses = 0;
+                    misses += VERTEX_CACHE_SIZE + 1;
+                }
+            }
+            return clusterMisses;
+        };
+
+        vector<size_t> clusters;
+        for (size_t c = 0; c < hardClusters.size(); c++)
+        {
+            const size_t begin = hardClusters[c];
+            const size_t end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : triangleCount;
+            const float clusterACMR = float(simulate(begin, end, 0.0f, nullptr)) / float(end - begin);
+            clusters.push_back(begin);
+            simulate(begin, end, clusterACMR * threshold, &clusters);
+        }
+        return clusters;
+    }
+
+    static glm::vec3 triangleCentroid(const vector<unsigned int>& indices, const vector<Vertex>& vertices, size_t triangle, float& area, glm::vec3& normal)
+    {
+        const glm::vec3& a = vertices[indices[triangle * 3 + 0]].Position;
+        const glm::vec3& b = vertices[indices[triangle * 3 + 1]].Position;
+        const glm::vec3& c = vertices[indices[triangle * 3 + 2]].Position;
+        normal = glm::cross(b - a, c - a); // length is twice the area, which weights the cluster normal by area
+        area = glm::length(normal) * 0.5f;
+        return (a + b + c) / 3.0f;
+    }
+};
+#endif
@@ -0,0 +1,401 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/mesh_optimizer.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+// Quadric error metric simplification (Garland & Heckbert 1997) with half-edge collapses: a vertex is always moved
+// onto one of its neighbours, so every level of detail reuses the original vertex buffer and only needs its own
+// index list. Vertices that share a position (UV or normal seams) are collapsed together, and seam and border
+// vertices only collapse onto other seam/border vertices so the mesh doesn't tear open.
+// Plain CPU work, safe to call from worker threads.
+class MeshSimplifier
+{
+public:
+    // builds levels 1.. of a mesh, each with about half the triangles of the previous one. Level n may deviate up to
+    // maxError * 2^(n-1) of the mesh's extent from the surface. Stops early when a level can't be reduced further.
+    static MeshLodChain GenerateLods(const vector<Vertex>& vertices, const vector<unsigned int>& indices, unsigned int levelCount = MAX_MESH_LODS, float maxError = 0.01f)
+    {
+        MeshLodChain chain;
+        if (indices.size() < MIN_LOD_TRIANGLES * 3 || indices.size() % 3 != 0)
+            return chain;
+
+        vector<unsigned int> previous = indices, level;
+        vector<size_t> clusters;
+        for (unsigned int n = 1; n < levelCount; n++)
+        {
+            const size_t target = previous.size() / 6 * 3;
+            float error = 0.0f;
+            level = Simplify(vertices, previous, target, maxError * float(1u << (n - 1)), error);
+            // not worth another level if simplification got stuck (hit the error bound or only constrained vertices remain)
+            if (level.empty() || level.size() > previous.size() * 85 / 100)
+                break;
+            level = MeshOptimizer::OptimizeVertexCache(level, vertices.size(), clusters);
+
+            chain.levels.push_back({ static_cast<unsigned int>(chain.indices.size()), static_cast<unsigned int>(level.size()), error });
+            chain.indices.insert(chain.indices.end(), level.begin(), level.end());
+            // the next level starts from this one
+            previous.swap(level);
+        }
+        return chain;
+    }
+
+    // simplifies a triangle list until it has at most targetIndexCount indices or the next collapse would move the
+    // surface more than maxError (relative to the mesh extent). error receives the largest error actually introduced.
+    static vector<unsigned int> Simplify(const vector<Vertex>& vertices, const vector<unsigned int>& indices, size_t targetIndexCount, float maxError, float& error)
+    {
+        Simplifier simplifier(vertices, indices);
+        return simplifier.run(targetIndexCount, maxError, error);
+    }
+
+private:
+    static const size_t MIN_LOD_TRIANGLES = 64;
+
+    // symmetric 4x4 matrix of the plane quadric; weight is the accumulated area so errors stay squared distances
+    struct Quadric
+    {
+        double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+        double weight = 0;
+
+        static Quadric FromPlane(const glm::dvec3& n, double d, double w)
+        {
+            Quadric q;
+            q.a2 = n.x * n.x * w; q.ab = n.x * n.y * w; q.ac = n.x * n.z * w; q.ad = n.x * d * w;
+            q.b2 = n.y * n.y * w; q.bc = n.y * n.z * w; q.bd = n.y * d * w;
+            q.c2 = n.z * n.z * w; q.cd = n.z * d * w;
+            q.d2 = d * d * w;
+            q.weight = w;
+            return q;
+        }
+
+        Quadric& operator+=(const Quadric& o)
+        {
+            a2 += o.a2; ab += o.ab; ac += o.ac; ad += o.ad; b2 += o.b2; bc += o.bc; bd += o.bd; c2 += o.c2; cd += o.cd; d2 += o.d2;
+            weight += o.weight;
+            return *this;
+        }
+
+        double Error(const glm::dvec3& p) const
+        {
+            const double e = a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+                           + b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+                           + c2 * p.z * p.z + 2 * cd * p.z
+                           + d2;
+            return weight > 0 ? std::fabs(e) / weight : 0.0;
+        }
+    };
+
+    struct Collapse
+    {
+        double       cost;
+        unsigned int from, to;            // positions ("reps")
+        unsigned int fromStamp, toStamp;  // version of both when the cost was computed
+
+        bool operator<(const Collapse& other) const { return cost > other.cost; } // min-heap
+    };
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const vector<Vertex>& vertices, const vector<unsigned int>& indices) : vertices(vertices), triangles(indices)
+        {
+            weldPositions(indices);
+            classify();
+            computeQuadrics();
+        }
+
+        vector<unsigned int> run(size_t targetIndexCount, float maxError, float& error)
+        {
+            const double maxCost = double(maxError) * extent * double(maxError) * extent;
+            size_t triangleCount = triangles.size() / 3;
+
+            for (unsigned int t = 0; t < triangleCount; t++)
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    const unsigned int a = rep[triangles[t * 3 + k]], b = rep[triangles[t * 3 + (k + 1) % 3]];
+                    pushCandidate(a, b);
+                    pushCandidate(b, a);
+                }
+
+            double largest = 0.0;
+            while (triangleCount * 3 > targetIndexCount && !queue.empty())
+            {
+                const Collapse collapse = queue.top();
+                queue.pop();
+                if (collapse.cost > maxCost)
+                    break;
+                if (!alive[collapse.from] || !alive[collapse.to] || stamp[collapse.from] != collapse.fromStamp || stamp[collapse.to] != collapse.toStamp)
+                    continue;
+                if (!canCollapse(collapse.from, collapse.to))
+                    continue;
+                triangleCount -= perform(collapse.from, collapse.to);
+                largest = std::max(largest, collapse.cost);
+            }
+
+            error = extent > 0 ? float(std::sqrt(largest) / extent) : 0.0f;
+            vector<unsigned int> result;
+            result.reserve(triangleCount * 3);
+            for (size_t t = 0; t < triangleAlive.size(); t++)
+                if (triangleAlive[t])
+                    result.insert(result.end(), triangles.begin() + t * 3, triangles.begin() + t * 3 + 3);
+            return result;
+        }
+
+    private:
+        const vector<Vertex>& vertices;
+        vector<unsigned int>  triangles;     // current vertex indices, rewritten as vertices collapse
+        vector<char>          triangleAlive;
+
+        // vertices sharing a position form one rep; reps are what collapse
+        vector<unsigned int>         rep;          // vertex -> rep
+        vector<glm::dvec3>           repPosition;
+        vector<vector<unsigned int>> repVertices;
+        vector<vector<unsigned int>> repTriangles; // may contain dead triangles, skipped lazily
+        vector<Quadric>              quadrics;
+        vector<char>                 constrained;  // on a seam or an open border
+        vector<char>                 alive;
+        vector<unsigned int>         stamp;
+        double                       extent = 0.0;
+
+        std::priority_queue<Collapse> queue;
+        vector<unsigned int>          remapFrom, remapTo; // scratch for perform()
+
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3& p) const
+            {
+                uint32_t bits[3];
+                std::memcpy(bits, &p, sizeof(bits));
+                return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+            }
+        };
+
+        static uint64_t edgeKey(unsigned int a, unsigned int b)
+        {
+            return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+        }
+
+        void weldPositions(const vector<unsigned int>& indices)
+        {
+            const unsigned int none = ~0u;
+            rep.assign(vertices.size(), none);
+            std::unordered_map<glm::vec3, unsigned int, PositionHash> reps;
+            glm::dvec3 minimum(1e30), maximum(-1e30);
+            for (unsigned int index : indices)
+            {
+                if (rep[index] != none)
+                    continue;
+                const glm::vec3& position = vertices[index].Position;
+                auto inserted = reps.emplace(position, static_cast<unsigned int>(repPosition.size()));
+                if (inserted.second)
+                {
+                    repPosition.push_back(glm::dvec3(position));
+                    repVertices.emplace_back();
+                    minimum = glm::min(minimum, glm::dvec3(position));
+                    maximum = glm::max(maximum, glm::dvec3(position));
+                }
+                rep[index] = inserted.first->second;
+                repVertices[rep[index]].push_back(index);
+            }
+            extent = glm::length(maximum - minimum);
+
+            const size_t repCount = repPosition.size();
+            repTriangles.resize(repCount);
+            triangleAlive.assign(triangles.size() / 3, 1);
+            for (unsigned int t = 0; t < triangles.size() / 3; t++)
+                for (unsigned int k = 0; k < 3; k++)
+                    repTriangles[rep[triangles[t * 3 + k]]].push_back(t);
+            alive.assign(repCount, 1);
+            stamp.assign(repCount, 0);
+        }
+
+        // seams: several vertices at one position. Borders: edges used by a single triangle.
+        void classify()
+        {
+            constrained.assign(repPosition.size(), 0);
+            for (size_t r = 0; r < repVertices.size(); r++)
+                if (repVertices[r].size() > 1)
+                    constrained[r] = 1;
+
+            std::unordered_map<uint64_t, unsigned int> edgeUse;
+            edgeUse.reserve(triangles.size());
+            for (size_t t = 0; t < triangles.size() / 3; t++)
+                for (unsigned int k = 0; k < 3; k++)
+                    edgeUse[edgeKey(rep[triangles[t * 3 + k]], rep[triangles[t * 3 + (k + 1) % 3]])]++;
+            for (const auto& edge : edgeUse)
+                if (edge.second == 1)
+                {
+                    constrained[edge.first >> 32] = 1;
+                    constrained[edge.first & 0xFFFFFFFFu] = 1;
+                }
+        }
+
+        void computeQuadrics()
+        {
+            quadrics.assign(repPosition.size(), Quadric());
+            std::unordered_map<uint64_t, unsigned int> edgeUse;
+            for (size_t t = 0; t < triangles.size() / 3; t++)
+            {
+                const unsigned int r[3] = { rep[triangles[t * 3]], rep[triangles[t * 3 + 1]], rep[triangles[t * 3 + 2]] };
+                const glm::dvec3 cross = glm::cross(repPosition[r[1]] - repPosition[r[0]], repPosition[r[2]] - repPosition[r[0]]);
+                const double length = glm::length(cross);
+                if (length <= 0.0)
+                    continue;
+                const glm::dvec3 normal = cross / length;
+                const Quadric q = Quadric::FromPlane(normal, -glm::dot(normal, repPosition[r[0]]), length * 0.5);
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    quadrics[r[k]] += q;
+                    edgeUse[edgeKey(r[k], r[(k + 1) % 3])]++;
+                }
+            }
+
+            // open borders get a heavily weighted plane through the edge, perpendicular to the surface, to keep their shape
+            for (size_t t = 0; t < triangles.size() / 3; t++)
+            {
+                const unsigned int r[3] = { rep[triangles[t * 3]], rep[triangles[t * 3 + 1]], rep[triangles[t * 3 + 2]] };
+                const glm::dvec3 normal = glm::cross(repPosition[r[1]] - repPosition[r[0]], repPosition[r[2]] - repPosition[r[0]]);
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    if (edgeUse[edgeKey(r[k], r[(k + 1) % 3])] != 1)
+                        continue;
+                    const glm::dvec3 edge = repPosition[r[(k + 1) % 3]] - repPosition[r[k]];
+                    glm::dvec3 perpendicular = glm::cross(edge, normal);
+                    const double length = glm::length(perpendicular);
+                    if (length <= 0.0)
+                        continue;
+                    perpendicular /= length;
+                    const Quadric q = Quadric::FromPlane(perpendicular, -glm::dot(perpendicular, repPosition[r[k]]), glm::dot(edge, edge) * 10.0);
+                    quadrics[r[k]] += q;
+                    quadrics[r[(k + 1) % 3]] += q;
+                }
+            }
+        }
+
+        void pushCandidate(unsigned int from, unsigned int to)
+        {
+            if (from == to || (constrained[from] && !constrained[to]))
+                return;
+            Quadric q = quadrics[from];
+            q += quadrics[to];
+            queue.push({ q.Error(repPosition[to]), from, to, stamp[from], stamp[to] });
+        }
+
+        // finds for every vertex of `from` a vertex of `to` it shares an edge with (its partner across the collapse)
+        bool findTargets(unsigned int from, unsigned int to)
+        {
+            remapFrom.clear();
+            remapTo.clear();
+            for (unsigned int v : repVertices[from])
+            {
+                unsigned int target = ~0u;
+                bool used = false;
+                for (unsigned int t : repTriangles[from])
+                {
+                    if (!triangleAlive[t])
+                        continue;
+                    const unsigned int* tri = &triangles[t * 3];
+                    if (tri[0] != v && tri[1] != v && tri[2] != v)
+                        continue;
+                    used = true;
+                    for (unsigned int k = 0; k < 3; k++)
+                        if (rep[tri[k]] == to)
+                            target = tri[k];
+                    if (target != ~0u)
+                        break;
+                }
+                if (!used)
+                    continue;
+                // a vertex without a partner would have to jump across the seam; collapsing would tear the mesh
+                if (target == ~0u)
+                    return false;
+                remapFrom.push_back(v);
+                remapTo.push_back(target);
+            }
+            return true;
+        }
+
+        bool canCollapse(unsigned int from, unsigned int to)
+        {
+            if (!findTargets(from, to))
+                return false;
+            // reject collapses that flip a remaining triangle around `from`
+            for (unsigned int t : repTriangles[from])
+            {
+                if (!triangleAlive[t])
+                    continue;
+                glm::dvec3 before[3], after[3];
+                bool degenerate = false;
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    const unsigned int r = rep[triangles[t * 3 + k]];
+                    degenerate |= r == to;
+                    before[k] = repPosition[r];
+                    after[k] = r == from ? repPosition[to] : repPosition[r];
+                }
+                if (degenerate)
+                    continue;
+                const glm::dvec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+                const glm::dvec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+                if (glm::dot(n0, n1) <= 0.0)
+                    return false;
+            }
+            return true;
+        }
+
+        // collapses rep `from` onto rep `to` (canCollapse must have just succeeded) and returns the triangles removed
+        size_t perform(unsigned int from, unsigned int to)
+        {
+            size_t removed = 0;
+            for (unsigned int t : repTriangles[from])
+            {
+                if (!triangleAlive[t])
+                    continue;
+                unsigned int* tri = &triangles[t * 3];
+                for (unsigned int k = 0; k < 3; k++)
+                    for (size_t i = 0; i < remapFrom.size(); i++)
+                        if (tri[k] == remapFrom[i])
+                            tri[k] = remapTo[i];
+                if (rep[tri[0]] == rep[tri[1]] || rep[tri[1]] == rep[tri[2]] || rep[tri[0]] == rep[tri[2]])
+                {
+                    triangleAlive[t] = 0;
+                    removed++;
+                }
+                else
+                    repTriangles[to].push_back(t);
+            }
+            for (unsigned int v : repVertices[from])
+                rep[v] = to;
+            repTriangles[from].clear();
+            alive[from] = 0;
+            quadrics[to] += quadrics[from];
+            constrained[to] |= constrained[from];
+
+            // drop dead triangles and requeue every edge around the grown rep with fresh costs
+            vector<unsigned int>& around = repTriangles[to];
+            around.erase(std::remove_if(around.begin(), around.end(), [this](unsigned int t) { return !triangleAlive[t]; }), around.end());
+            stamp[to]++;
+            for (unsigned int t : around)
+                for (unsigned int k = 0; k < 3; k++)
+                {
+                    const unsigned int neighbour = rep[triangles[t * 3 + k]];
+                    if (neighbour == to)
+                        continue;
+                    pushCandidate(to, neighbour);
+                    pushCandidate(neighbour, to);
+                }
+            return removed;
+        }
+    };
+};
+#endif
@@ -11,13 +11,20 @@
 #include <assimp/postprocess.h>
 
 #include <learnopengl/mesh.h>
+#include <learnopengl/mesh_cache.h>
+#include <learnopengl/mesh_optimizer.h>
+#include <learnopengl/mesh_simplifier.h>
+#include <learnopengl/parallel.h>
+#include <learnopengl/texture_cache.h>
 #include <learnopengl/shader.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
 #include <map>
+#include <unordered_map>
 #include <vector>
 using namespace std;
 
@@ -31,70 +38,197 @@ public:
     vector<Mesh>    meshes;
     string directory;
     bool gammaCorrection;
+    bool asyncTextures; // if false the constructor waits until all textures are uploaded
+    VertexLayout vertexLayout; // GPU vertex format every mesh of this model is uploaded with
+
+    // what loading this model did and how long it took; nothing is printed unless the caller asks, see PrintLoadStats()
+    struct LoadStats
+    {
+        bool   fromCache = false;
+        double loadMs    = 0.0;   // the whole load, cache or Assimp import
+        size_t meshCount = 0;
+        // only filled by an Assimp import
+        double processMs = 0.0;   // converting, optimising and simplifying the meshes
+        unsigned int workerCount = 0;
+        MeshOptimizeStats optimize; // summed over all meshes
+    };
+    LoadStats loadStats;
+
+    // Assimp post-processing used on import; part of the mesh cache key
+    static const unsigned int importFlags = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
 
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, VertexLayout layout = VERTEX_LAYOUT_STATIC_PACKED, bool async = false) : gammaCorrection(gamma), asyncTextures(async), vertexLayout(layout)
     {
         loadModel(path);
+        // textures were decoded in parallel while the meshes were processed; block for the stragglers unless the caller
+        // pumps TextureCache::Instance().Update() every frame and is fine with placeholders in the meantime
+        if (!asyncTextures)
+            TextureCache::Instance().Flush();
     }
 
     // draws the model, and thus all its meshes
-    void Draw(Shader &shader)
+    void Draw(Shader &shader, unsigned int lod = 0)
     {
         for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+            meshes[i].Draw(shader, lod);
+    }
+
+    // triangles drawn at the given level of detail
+    size_t TriangleCount(unsigned int lod = 0) const
+    {
+        size_t triangles = 0;
+        for (const Mesh& mesh : meshes)
+            triangles += mesh.Lod(lod).indexCount / 3;
+        return triangles;
+    }
+
+    // prints the triangle count of every level of detail
+    void PrintLods() const
+    {
+        cout << "MODEL::LOD " << directory << ":";
+        for (unsigned int lod = 0; lod < MAX_MESH_LODS; lod++)
+            cout << " " << TriangleCount(lod);
+        cout << " triangles" << endl;
+    }
+
+    // prints loadStats: load time, and for an Assimp import the processing time and vertex cache gains
+    void PrintLoadStats() const
+    {
+        cout << "MODEL::LOAD " << directory << " took " << loadStats.loadMs << " ms (" << (loadStats.fromCache ? "cache" : "assimp") << ")" << endl;
+        if (loadStats.fromCache)
+            return;
+        cout << "MODEL::PROCESS converted, optimised and simplified " << loadStats.meshCount << " meshes in " << loadStats.processMs << " ms on " << loadStats.workerCount << " threads" << endl;
+        cout << "MODEL::OPTIMIZE ACMR " << loadStats.optimize.before.ACMR() << " -> " << loadStats.optimize.after.ACMR()
+             << ", ATVR " << loadStats.optimize.before.ATVR() << " -> " << loadStats.optimize.after.ATVR() << endl;
+    }
+
+    // prints the VRAM used by the meshes of this model and the savings of the packed vertex layout
+    void PrintVertexMemory() const
+    {
+        ::PrintVertexMemory(meshes, directory);
     }
     
 private:
+    unordered_map<string, size_t> texturesLoadedIndex; // path -> index into textures_loaded
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        const auto start = chrono::high_resolution_clock::now();
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // a valid binary cache (same file, mtime and import flags) skips the Assimp import entirely
+        MeshCacheData cached;
+        if (MeshCache::Load(path, importFlags, cached))
+        {
+            loadCachedModel(cached);
+            loadStats.fromCache = true;
+            recordLoadTime(start);
+            return;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+        const aiScene* scene = importer.ReadFile(path, importFlags);
         // check for errors
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
         {
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
-        // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        // convert every mesh of the scene (in parallel)
+        processScene(scene);
+
+        if (!MeshCache::Save(path, importFlags, meshes))
+            cout << "ERROR::MESH_CACHE:: could not write " << MeshCache::CachePath(path) << endl;
+        recordLoadTime(start);
     }
 
-    // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // builds the meshes from a binary cache instead of an Assimp scene
+    void loadCachedModel(MeshCacheData& cached)
     {
-        // process each mesh located at the current node
+        meshes.reserve(cached.meshes.size());
+        for (CachedMesh& cachedMesh : cached.meshes)
+        {
+            vector<Texture> textures;
+            for (const CachedTexture& texture : cachedMesh.textures)
+                textures.push_back(loadTexture(texture.path.c_str(), texture.type));
+            meshes.push_back(Mesh(std::move(cachedMesh.vertices), std::move(cachedMesh.indices), textures, vertexLayout, std::move(cachedMesh.lodChain)));
+        }
+    }
+
+    void recordLoadTime(chrono::high_resolution_clock::time_point start)
+    {
+        loadStats.meshCount = meshes.size();
+        loadStats.loadMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+    }
+
+    // builds the meshes of an imported scene in three stages: gather every mesh of the node tree and resolve its
+    // material on this thread, convert vertices and indices on worker threads, then create the GL buffers here again.
+    void processScene(const aiScene *scene)
+    {
+        vector<const aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+        const size_t count = sceneMeshes.size();
+
+        // materials first, so the texture cache decodes images while the vertices are being converted
+        vector<vector<Texture>> textures(count);
+        for (size_t i = 0; i < count; i++)
+            textures[i] = processMaterial(scene->mMaterials[sceneMeshes[i]->mMaterialIndex]);
+
+        const auto convertStart = chrono::high_resolution_clock::now();
+        vector<vector<Vertex>> vertices(count);
+        vector<vector<unsigned int>> indices(count);
+        vector<MeshOptimizeStats> optimizeStats(count);
+        vector<MeshLodChain> lodChains(count);
+        ParallelFor(count, [&](size_t i)
+        {
+            processMesh(sceneMeshes[i], vertices[i], indices[i]);
+            optimizeStats[i] = MeshOptimizer::Optimize(vertices[i], indices[i]);
+            lodChains[i] = MeshSimplifier::GenerateLods(vertices[i], indices[i]);
+        });
+        loadStats.processMs = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - convertStart).count();
+        loadStats.workerCount = WorkerCount();
+        for (const MeshOptimizeStats& stats : optimizeStats)
+            loadStats.optimize += stats;
+
+        // GL objects can only be created on the context's thread
+        meshes.reserve(meshes.size() + count);
+        for (size_t i = 0; i < count; i++)
+            meshes.push_back(Mesh(std::move(vertices[i]), std::move(indices[i]), std::move(textures[i]), vertexLayout, std::move(lodChains[i])));
+    }
+
+    // collects the meshes of a node and, recursively, of its children in draw order
+    void processNode(aiNode *node, const aiScene *scene, vector<const aiMesh*> &sceneMeshes)
+    {
+        // collect each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
-            aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
         }
-        // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
+        // after we've collected all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, sceneMeshes);
         }
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // converts the vertices and indices of an aiMesh into pre-sized arrays. Runs on worker threads, so it must only
+    // read the scene and write its own outputs.
+    static void processMesh(const aiMesh *mesh, vector<Vertex> &vertices, vector<unsigned int> &indices)
     {
-        // data to fill
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
+        vertices.resize(mesh->mNumVertices);
 
         // walk through each of the mesh's vertices
         for(unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            Vertex vertex;
+            Vertex& vertex = vertices[i];
             glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
             // positions
             vector.x = mesh->mVertices[i].x;
@@ -131,19 +265,26 @@ private:
             }
             else
                 vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-
-            vertices.push_back(vertex);
         }
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
+        size_t indexCount = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        indices.resize(indexCount);
+        unsigned int* out = indices.data();
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace& face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);        
+                *out++ = face.mIndices[j];
         }
-        // process materials
-        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
+    }
+
+    // loads the textures of a material. Touches GL and the texture maps, so it stays on the main thread.
+    vector<Texture> processMaterial(aiMaterial *material)
+    {
+        vector<Texture> textures;
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
@@ -163,9 +304,7 @@ private:
         // 4. height maps
         std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
-        
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        return textures;
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -177,29 +316,28 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
-            {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            textures.push_back(loadTexture(str.C_Str(), typeName));
         }
         return textures;
     }
+
+    // returns the texture at path (relative to the model directory). Images are shared through the process-wide
+    // TextureCache and decoded on its worker threads; the returned id shows a placeholder until the data is uploaded.
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        // check if this model already uses the texture and if so, reuse it
+        auto it = texturesLoadedIndex.find(path);
+        if (it != texturesLoadedIndex.end())
+            return textures_loaded[it->second];
+
+        Texture texture;
+        texture.id = TextureCache::Instance().Request(this->directory + '/' + path);
+        texture.type = typeName;
+        texture.path = path;
+        texturesLoadedIndex.emplace(texture.path, textures_loaded.size());
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
+        return texture;
+    }
 };
 
 
@@ -0,0 +1,145 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// number of threads ParallelFor uses by default (the calling thread included)
+inline unsigned int WorkerCount()
+{
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+// calls fn(i) for every i in [0, count) spread over up to threadCount threads; the calling thread takes part and the
+// call returns when every index has been processed. Indices are handed out one at a time so uneven work (a few huge
+// meshes next to many small ones) still balances. fn must not touch GL or any other thread-affine state.
+template<typename Fn>
+void ParallelFor(size_t count, Fn fn, unsigned int threadCount = WorkerCount())
+{
+    threadCount = static_cast<unsigned int>(std::min<size_t>(threadCount, count));
+    if (threadCount <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+            fn(i);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount - 1);
+    for (unsigned int t = 1; t < threadCount; t++)
+        threads.emplace_back(work);
+    work();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+// Persistent threads for work that repeats every frame, where starting threads per call (as ParallelFor does) would
+// cost more than the work itself. Run() has the same contract as ParallelFor and doesn't allocate.
+class WorkerPool
+{
+public:
+    // threadCount includes the calling thread, which always takes part in Run()
+    explicit WorkerPool(unsigned int threadCount = WorkerCount())
+    {
+        for (unsigned int t = 1; t < threadCount; t++)
+            threads.emplace_back([this] { workerLoop(); });
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    unsigned int ThreadCount() const { return static_cast<unsigned int>(threads.size()) + 1; }
+
+    // calls fn(i) for every i in [0, count) and returns when all calls have finished
+    template<typename Fn>
+    void Run(size_t count, Fn& fn)
+    {
+        if (threads.empty() || count <= 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                fn(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            invoke = [](void* context, size_t i) { (*static_cast<Fn*>(context))(i); };
+            context = &fn;
+            jobCount = count;
+            next = 0;
+            busy = static_cast<unsigned int>(threads.size());
+            generation++;
+        }
+        wake.notify_all();
+        runJob();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busy == 0; });
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping = false;
+    uint64_t generation = 0;
+    unsigned int busy = 0;
+
+    // the current job, type-erased without allocating
+    void (*invoke)(void*, size_t) = nullptr;
+    void* context = nullptr;
+    size_t jobCount = 0;
+    std::atomic<size_t> next{ 0 };
+
+    void runJob()
+    {
+        for (size_t i = next++; i < jobCount; i = next++)
+            invoke(context, i);
+    }
+
+    void workerLoop()
+    {
+        uint64_t seen = 0;
+        for (;;)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+            runJob();
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (--busy == 0)
+                    done.notify_one();
+            }
+        }
+    }
+};
+#endif
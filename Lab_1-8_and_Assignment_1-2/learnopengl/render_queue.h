@@ -0,0 +1,161 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <learnopengl/mesh.h>
+#include <learnopengl/shader.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// Per-frame counters filled in by RenderQueue::Submit.
+struct RenderStats
+{
+    unsigned int drawCalls    = 0;
+    unsigned int programBinds = 0;
+    unsigned int textureBinds = 0;
+    unsigned int vaoBinds     = 0;
+    unsigned int samplerSets  = 0;
+    size_t       triangles    = 0;
+    double       submitMs     = 0.0; // CPU time spent inside Submit
+};
+
+// One mesh draw recorded during culling.
+struct DrawPacket
+{
+    uint64_t    key;
+    Shader*     shader;
+    const Mesh* mesh;
+    glm::mat4   model;
+    unsigned int lod;
+};
+
+// Collects draw packets during culling, sorts them by a 64-bit state key and submits them in order,
+// skipping program, texture and VAO binds that are already current.
+//
+// Key layout (most significant first):
+//   [63..48] shader program id
+//   [47..24] material (hash of the mesh's texture ids)
+//   [23.. 0] vertex array object id
+class RenderQueue
+{
+public:
+    RenderStats stats;
+
+    RenderQueue(size_t reserve = 1024)
+    {
+        packets.reserve(reserve);
+    }
+
+    static uint64_t MakeKey(unsigned int program, uint64_t material, unsigned int vao)
+    {
+        return (uint64_t(program & 0xFFFF) << 48) |
+               ((material & 0xFFFFFF) << 24) |
+               uint64_t(vao & 0xFFFFFF);
+    }
+
+    // record a single mesh
+    void Add(Shader& shader, const Mesh& mesh, const glm::mat4& model, unsigned int lod = 0)
+    {
+        packets.push_back({ MakeKey(shader.ID, mesh.materialKey, mesh.VAO), &shader, &mesh, model, lod });
+    }
+
+    // record every mesh of a model (works with both model.h and model_animation.h)
+    template<typename TModel>
+    void AddModel(Shader& shader, const TModel& model, const glm::mat4& modelMatrix, unsigned int lod = 0)
+    {
+        for (const Mesh& mesh : model.meshes)
+            Add(shader, mesh, modelMatrix, lod);
+    }
+
+    size_t Size() const { return packets.size(); }
+
+    // sort by key and issue all recorded draws, then empty the queue for the next frame
+    void Submit()
+    {
+        const auto start = std::chrono::high_resolution_clock::now();
+        stats = RenderStats();
+
+        std::sort(packets.begin(), packets.end(), [](const DrawPacket& a, const DrawPacket& b) { return a.key < b.key; });
+
+        unsigned int currentProgram = 0;
+        UniformHandle modelHandle   = { -1 };
+        unsigned int currentVAO     = 0;
+        const Mesh*  currentMaterial = nullptr;
+        uint64_t     currentMaterialKey = 0;
+        std::fill(boundTextures, boundTextures + MAX_TEXTURE_UNITS, 0u);
+        glActiveTexture(GL_TEXTURE0);
+        unsigned int activeUnit = 0;
+
+        for (const DrawPacket& packet : packets)
+        {
+            const Mesh& mesh = *packet.mesh;
+
+            bool programChanged = false;
+            if (packet.shader->ID != currentProgram)
+            {
+                currentProgram = packet.shader->ID;
+                glUseProgram(currentProgram);
+                modelHandle = packet.shader->location("model");
+                stats.programBinds++;
+                programChanged = true;
+            }
+
+            // sampler uniforms are program state, so they must be re-sent when either the program or the material changes
+            if (programChanged || !currentMaterial || mesh.materialKey != currentMaterialKey || mesh.textures.size() != currentMaterial->textures.size())
+            {
+                for (unsigned int i = 0; i < mesh.textures.size() && i < MAX_TEXTURE_UNITS; i++)
+                {
+                    packet.shader->setInt(mesh.samplerNames[i], i);
+                    stats.samplerSets++;
+                    if (boundTextures[i] != mesh.textures[i].id)
+                    {
+                        if (activeUnit != i)
+                        {
+                            glActiveTexture(GL_TEXTURE0 + i);
+                            activeUnit = i;
+                        }
+                        glBindTexture(GL_TEXTURE_2D, mesh.textures[i].id);
+                        boundTextures[i] = mesh.textures[i].id;
+                        stats.textureBinds++;
+                    }
+                }
+                currentMaterial = &mesh;
+                currentMaterialKey = mesh.materialKey;
+            }
+
+            packet.shader->setMat4(modelHandle, packet.model);
+
+            if (mesh.VAO != currentVAO)
+            {
+                currentVAO = mesh.VAO;
+                glBindVertexArray(currentVAO);
+                stats.vaoBinds++;
+            }
+            const MeshLod& level = mesh.Lod(packet.lod);
+            glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(unsigned int)));
+            stats.drawCalls++;
+            stats.triangles += level.indexCount / 3;
+        }
+
+        // always good practice to set everything back to defaults once configured.
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        packets.clear();
+
+        const auto end = std::chrono::high_resolution_clock::now();
+        stats.submitMs = std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+private:
+    static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+    std::vector<DrawPacket> packets;
+    unsigned int boundTextures[MAX_TEXTURE_UNITS] = {};
+};
+#endif
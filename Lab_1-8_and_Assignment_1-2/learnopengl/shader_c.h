@@ -4,10 +4,13 @@
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 
+#include <learnopengl/uniform_cache.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class ComputeShader
 {
@@ -53,6 +56,7 @@ public:
         glAttachShader(ID, compute);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        cacheUniformLocations();
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(compute);
     }
@@ -62,66 +66,165 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // returns the location of a uniform from the per-program cache; keep the handle around to skip even the hash lookup on hot paths
+    // ------------------------------------------------------------------------
+    UniformHandle location(UniformName name) const
+    {
+        GLint loc;
+        if (uniformLocations.find(name, loc))
+            return UniformHandle{ loc };
+        // not reported as active at link time; ask GL once and remember the answer (-1 included)
+        loc = glGetUniformLocation(ID, name.data);
+        uniformLocations.insert(name, loc);
+        return UniformHandle{ loc };
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformName name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name).value, (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformName name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name).value, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformName name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name).value, value); 
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const
+    void setVec2(UniformName name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(location(name).value, 1, &value[0]); 
     }
-    void setVec2(const std::string &name, float x, float y) const
+    void setVec2(UniformName name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(location(name).value, x, y); 
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const
+    void setVec3(UniformName name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(location(name).value, 1, &value[0]); 
     }
-    void setVec3(const std::string &name, float x, float y, float z) const
+    void setVec3(UniformName name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(location(name).value, x, y, z); 
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const
+    void setVec4(UniformName name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(location(name).value, 1, &value[0]); 
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) 
+    void setVec4(UniformName name, float x, float y, float z, float w) 
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(location(name).value, x, y, z, w); 
+    }
+    // ------------------------------------------------------------------------
+    void setMat2(UniformName name, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(location(name).value, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const
+    void setMat3(UniformName name, const glm::mat3 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(location(name).value, 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const
+    void setMat4(UniformName name, const glm::mat4 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(location(name).value, 1, GL_FALSE, &mat[0][0]);
     }
+    // handle-based overloads: no string hashing or GL query per call
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.value, (int)value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.value, value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.value, value);
+    }
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        glUniform2fv(handle.value, 1, &value[0]);
+    }
+    void setVec2(UniformHandle handle, float x, float y) const
+    {
+        glUniform2f(handle.value, x, y);
+    }
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        glUniform3fv(handle.value, 1, &value[0]);
+    }
+    void setVec3(UniformHandle handle, float x, float y, float z) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniform3f(handle.value, x, y, z);
+    }
+    void setVec4(UniformHandle handle, const glm::vec4 &value) const
+    {
+        glUniform4fv(handle.value, 1, &value[0]);
+    }
+    void setVec4(UniformHandle handle, float x, float y, float z, float w) const
+    {
+        glUniform4f(handle.value, x, y, z, w);
+    }
+    void setMat2(UniformHandle handle, const glm::mat2 &mat) const
+    {
+        glUniformMatrix2fv(handle.value, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat3(UniformHandle handle, const glm::mat3 &mat) const
+    {
+        glUniformMatrix3fv(handle.value, 1, GL_FALSE, &mat[0][0]);
+    }
+    void setMat4(UniformHandle handle, const glm::mat4 &mat) const
+    {
+        glUniformMatrix4fv(handle.value, 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // cached uniform locations, keyed by name
+    mutable UniformLocationCache uniformLocations;
+
+    // fills the location cache by reflecting over the active uniforms right after linking
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint loc = glGetUniformLocation(ID, name.c_str());
+            if (loc < 0)
+                continue; // members of uniform blocks have no location
+            uniformLocations.insert(name, loc);
+            // arrays are reported as "name[0]"; also register the bare name and every element
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations.insert(base, loc);
+                for (GLint e = 1; e < size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    uniformLocations.insert(element, glGetUniformLocation(ID, element.c_str()));
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -3,10 +3,13 @@
 
 #include <glad/glad.h>
 
+#include <learnopengl/uniform_cache.h>
+
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
@@ -64,6 +67,7 @@ public:
         glAttachShader(ID, fragment);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
+        cacheUniformLocations();
         // delete the shaders as they're linked into our program now and no longer necessary
         glDeleteShader(vertex);
         glDeleteShader(fragment);
@@ -74,24 +78,87 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // returns the location of a uniform from the per-program cache; keep the handle around to skip even the hash lookup on hot paths
+    // ------------------------------------------------------------------------
+    UniformHandle location(UniformName name) const
+    {
+        GLint loc;
+        if (uniformLocations.find(name, loc))
+            return UniformHandle{ loc };
+        // not reported as active at link time; ask GL once and remember the answer (-1 included)
+        loc = glGetUniformLocation(ID, name.data);
+        uniformLocations.insert(name, loc);
+        return UniformHandle{ loc };
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const
+    void setBool(UniformName name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name).value, (int)value); 
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const
+    void setInt(UniformName name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name).value, value); 
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const
+    void setFloat(UniformName name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name).value, value); 
+    }
+    // handle-based overloads: no string hashing or GL query per call
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.value, (int)value);
+    }
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.value, value);
+    }
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.value, value);
     }
 
 private:
+    // cached uniform locations, keyed by name
+    mutable UniformLocationCache uniformLocations;
+
+    // fills the location cache by reflecting over the active uniforms right after linking
+    // ------------------------------------------------------------------------
+    void cacheUniformLocations()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(maxLength > 0 ? maxLength : 1);
+        for (GLint i = 0; i < count; i++)
+        {
+            GLint size = 0;
+            GLenum type = 0;
+            GLsizei length = 0;
+            glGetActiveUniform(ID, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &size, &type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            GLint loc = glGetUniformLocation(ID, name.c_str());
+            if (loc < 0)
+                continue; // members of uniform blocks have no location
+            uniformLocations.insert(name, loc);
+            // arrays are reported as "name[0]"; also register the bare name and every element
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = name.substr(0, name.size() - 3);
+                uniformLocations.insert(base, loc);
+                for (GLint e = 1; e < size; e++)
+                {
+                    std::string element = base + "[" + std::to_string(e) + "]";
+                    uniformLocations.insert(element, glGetUniformLocation(ID, element.c_str()));
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, std::string type)
@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+// per-instance model matrix, filled by InstancedRenderer (INSTANCE_MATRIX_LOCATION)
+layout (location = 7) in mat4 aInstanceMatrix;
+
+out vec2 TexCoords;
+
+// per-frame camera data, uploaded once per frame by UniformBuffer<FrameUniforms> (FRAME_UBO_BINDING)
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 frustumPlanes[6];
+    vec4 cameraPosition;
+    vec4 time;
+};
+
+void main()
+{
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * aInstanceMatrix * vec4(aPos, 1.0);
+}
@@ -0,0 +1,57 @@
+#version 330 core
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 boneIds;
+layout (location = 6) in vec4 weights;
+
+out vec2 TexCoords;
+
+// per-frame camera data, uploaded once per frame by UniformBuffer<FrameUniforms> (FRAME_UBO_BINDING)
+layout (std140) uniform FrameData
+{
+    mat4 projection;
+    mat4 view;
+    mat4 viewProjection;
+    vec4 frustumPlanes[6];
+    vec4 cameraPosition;
+    vec4 time;
+};
+
+const int MAX_BONE_INFLUENCE = 4;
+
+// palettes written by AnimationCrowd::Upload: per instance the model matrix, then the bone matrices
+uniform samplerBuffer bonePalettes;
+uniform int paletteStride; // matrices per instance
+uniform int paletteBase;   // first instance of this draw
+
+mat4 fetchMatrix(int index)
+{
+    int texel = index * 4;
+    return mat4(texelFetch(bonePalettes, texel),
+                texelFetch(bonePalettes, texel + 1),
+                texelFetch(bonePalettes, texel + 2),
+                texelFetch(bonePalettes, texel + 3));
+}
+
+void main()
+{
+    int base = (paletteBase + gl_InstanceID) * paletteStride;
+    mat4 model = fetchMatrix(base);
+
+    vec4 totalPosition = vec4(0.0);
+    for (int i = 0; i < MAX_BONE_INFLUENCE; i++)
+    {
+        if (boneIds[i] == -1)
+            continue;
+        if (boneIds[i] >= paletteStride - 1)
+        {
+            totalPosition = vec4(aPos, 1.0);
+            break;
+        }
+        totalPosition += fetchMatrix(base + 1 + boneIds[i]) * vec4(aPos, 1.0) * weights[i];
+    }
+
+    TexCoords = aTexCoords;
+    gl_Position = viewProjection * model * totalPosition;
+}
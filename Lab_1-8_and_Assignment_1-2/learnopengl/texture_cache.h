@@ -0,0 +1,260 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Process-wide texture cache. Every image is loaded once per canonical path no matter how many models use it.
+//
+// Request() returns a GL texture name immediately; the texture holds a 1x1 grey placeholder while worker threads
+// decode the file with stb_image. The decoded pixels are uploaded on the GL thread, through a pixel buffer object,
+// by Update() (call it once per frame with a byte budget) or Flush() (blocks until everything requested is uploaded).
+// Because the texture name never changes, meshes can be drawn with it right away.
+class TextureCache
+{
+public:
+    static TextureCache& Instance()
+    {
+        static TextureCache cache;
+        return cache;
+    }
+
+    // returns the texture for path, queueing it for decoding if it hasn't been requested before. GL thread only.
+    unsigned int Request(const std::string& path)
+    {
+        const std::string key = canonicalPath(path);
+        auto it = textures.find(key);
+        if (it != textures.end())
+            return it->second;
+
+        unsigned int textureID = createPlaceholder();
+        textures.emplace(key, textureID);
+        startWorkers();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({ textureID, key });
+        }
+        inFlight++;
+        jobReady.notify_one();
+        return textureID;
+    }
+
+    // uploads decoded images until roughly byteBudget bytes have been sent this call (always at least one). GL thread only.
+    void Update(size_t byteBudget = 8 * 1024 * 1024)
+    {
+        std::vector<DecodedImage> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t bytes = 0;
+            while (!decoded.empty() && (ready.empty() || bytes < byteBudget))
+            {
+                bytes += decoded.front().size();
+                ready.push_back(decoded.front());
+                decoded.pop_front();
+            }
+        }
+        for (DecodedImage& image : ready)
+            upload(image);
+    }
+
+    // waits for every requested image and uploads it; model load time is then bound by the slowest image. GL thread only.
+    void Flush()
+    {
+        while (inFlight > 0)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                imageReady.wait(lock, [this] { return !decoded.empty(); });
+            }
+            Update(SIZE_MAX);
+        }
+    }
+
+    // number of requested textures that still show the placeholder
+    size_t Pending() const { return inFlight; }
+
+    // deletes all cached textures; call before destroying the GL context. GL thread only.
+    void Clear()
+    {
+        Flush();
+        for (auto& texture : textures)
+            glDeleteTextures(1, &texture.second);
+        textures.clear();
+        if (pbo)
+        {
+            glDeleteBuffers(1, &pbo);
+            pbo = 0;
+        }
+    }
+
+    ~TextureCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+        for (DecodedImage& image : decoded)
+            stbi_image_free(image.data);
+    }
+
+private:
+    struct DecodeJob
+    {
+        unsigned int id;
+        std::string  path;
+    };
+
+    struct DecodedImage
+    {
+        unsigned int   id;
+        std::string    path;
+        unsigned char* data;
+        int width, height, components;
+
+        size_t size() const { return data ? size_t(width) * height * components : 0; }
+    };
+
+    // GL thread state
+    std::unordered_map<std::string, unsigned int> textures;
+    size_t inFlight = 0;
+    unsigned int pbo = 0;
+
+    // shared with the workers, guarded by mutex
+    std::mutex mutex;
+    std::condition_variable jobReady;
+    std::condition_variable imageReady;
+    std::deque<DecodeJob> jobs;
+    std::deque<DecodedImage> decoded;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    TextureCache() = default;
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    static std::string canonicalPath(const std::string& path)
+    {
+        std::error_code error;
+        std::filesystem::path canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.generic_string();
+    }
+
+    void startWorkers()
+    {
+        if (!workers.empty())
+            return;
+        const unsigned int count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (unsigned int i = 0; i < count; i++)
+            workers.emplace_back([this] { workerLoop(); });
+    }
+
+    void workerLoop()
+    {
+        for (;;)
+        {
+            DecodeJob job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+            }
+
+            DecodedImage image{ job.id, job.path, nullptr, 0, 0, 0 };
+            image.data = stbi_load(job.path.c_str(), &image.width, &image.height, &image.components, 0);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoded.push_back(image);
+            }
+            imageReady.notify_all();
+        }
+    }
+
+    static void setSamplerState()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    static unsigned int createPlaceholder()
+    {
+        static const unsigned char grey[4] = { 128, 128, 128, 255 };
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        setSamplerState();
+        return textureID;
+    }
+
+    void upload(DecodedImage& image)
+    {
+        inFlight--;
+        if (!image.data)
+        {
+            std::cout << "Texture failed to load at path: " << image.path << std::endl;
+            return;
+        }
+
+        GLenum format = GL_RGBA;
+        if (image.components == 1)
+            format = GL_RED;
+        else if (image.components == 2)
+            format = GL_RG;
+        else if (image.components == 3)
+            format = GL_RGB;
+
+        // stage the pixels in a PBO so the driver can copy them to the texture asynchronously
+        if (!pbo)
+            glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, image.size(), NULL, GL_STREAM_DRAW);
+        void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, image.size(), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (staging)
+        {
+            memcpy(staging, image.data, image.size());
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        else
+        {
+            // mapping failed; upload straight from client memory instead
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, image.id);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // with a PBO bound the last argument is an offset into it
+        glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, staging ? (void*)0 : image.data);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        setSamplerState();
+
+        stbi_image_free(image.data);
+        image.data = nullptr;
+    }
+};
+#endif
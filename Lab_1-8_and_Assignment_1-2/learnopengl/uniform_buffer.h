@@ -0,0 +1,203 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <string>
+
+// Fixed binding points shared by every program; Shader binds blocks with these names automatically after linking.
+#define FRAME_UBO_BINDING 0
+#define SCENE_UBO_BINDING 1
+
+#define MAX_POINT_LIGHTS 8
+
+// The structs below mirror std140 blocks, so they only use vec4/mat4/ivec4 members (no padding surprises).
+// Matching GLSL declarations:
+//
+//   layout (std140) uniform FrameData
+//   {
+//       mat4 projection;
+//       mat4 view;
+//       mat4 viewProjection;
+//       vec4 frustumPlanes[6]; // xyz = normal, w = distance
+//       vec4 cameraPosition;   // w unused
+//       vec4 time;             // x = seconds since start, y = delta time
+//   };
+//
+//   struct DirLight   { vec4 direction; vec4 ambient; vec4 diffuse; vec4 specular; };
+//   struct PointLight { vec4 position; vec4 ambient; vec4 diffuse; vec4 specular; vec4 attenuation; }; // attenuation = constant, linear, quadratic
+//   layout (std140) uniform SceneData
+//   {
+//       DirLight dirLight;
+//       PointLight pointLights[MAX_POINT_LIGHTS];
+//       ivec4 lightCounts; // x = number of active point lights
+//   };
+
+struct FrameUniforms
+{
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection;
+    glm::vec4 frustumPlanes[6];
+    glm::vec4 cameraPosition;
+    glm::vec4 time;
+};
+
+struct DirLightStd140
+{
+    glm::vec4 direction;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+
+struct PointLightStd140
+{
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    glm::vec4 attenuation;
+};
+
+struct SceneUniforms
+{
+    DirLightStd140   dirLight;
+    PointLightStd140 pointLights[MAX_POINT_LIGHTS];
+    glm::ivec4       lightCounts;
+};
+
+// fills the per-frame block; the frustum planes are extracted from the view-projection matrix (Gribb/Hartmann)
+inline FrameUniforms MakeFrameUniforms(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& cameraPosition, float time, float deltaTime)
+{
+    FrameUniforms frame;
+    frame.projection = projection;
+    frame.view = view;
+    frame.viewProjection = projection * view;
+    const glm::mat4& m = frame.viewProjection;
+    for (int i = 0; i < 3; i++)
+    {
+        // left/right, bottom/top, near/far: row3 +/- row i
+        glm::vec4 plus(m[0][3] + m[0][i], m[1][3] + m[1][i], m[2][3] + m[2][i], m[3][3] + m[3][i]);
+        glm::vec4 minus(m[0][3] - m[0][i], m[1][3] - m[1][i], m[2][3] - m[2][i], m[3][3] - m[3][i]);
+        frame.frustumPlanes[i * 2 + 0] = plus / glm::length(glm::vec3(plus));
+        frame.frustumPlanes[i * 2 + 1] = minus / glm::length(glm::vec3(minus));
+    }
+    frame.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    frame.time = glm::vec4(time, deltaTime, 0.0f, 0.0f);
+    return frame;
+}
+
+// Persistent mapping needs glBufferStorage (GL 4.4 or ARB_buffer_storage). A glad generated for GL 3.3 declares
+// neither, so that path is only compiled when the loader has it, and only taken when the context has it.
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define UNIFORM_BUFFER_STORAGE
+#endif
+
+// whether the current context can create persistently mapped buffers
+inline bool UniformBufferStorageSupported()
+{
+#if defined(GL_VERSION_4_4)
+    if (GLAD_GL_VERSION_4_4)
+        return true;
+#endif
+#if defined(GL_ARB_buffer_storage)
+    if (GLAD_GL_ARB_buffer_storage)
+        return true;
+#endif
+    return false;
+}
+
+// A uniform buffer bound to a fixed binding point. Update() uploads the whole block with one glBufferSubData, or,
+// when created persistent, writes into a persistently mapped ring of three regions guarded by fences so the CPU
+// never overwrites data the GPU is still reading. Asking for persistent on a context without buffer storage falls
+// back to glBufferSubData.
+template<typename T>
+class UniformBuffer
+{
+public:
+    unsigned int ID = 0;
+
+    UniformBuffer(GLuint binding, bool persistent = false) : binding(binding), persistent(persistent && UniformBufferStorageSupported())
+    {
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_UNIFORM_BUFFER, ID);
+#ifdef UNIFORM_BUFFER_STORAGE
+        if (this->persistent)
+        {
+            GLint alignment = 256;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_UNIFORM_BUFFER, stride * RING_SIZE, NULL, flags);
+            mapped = static_cast<char*>(glMapBufferRange(GL_UNIFORM_BUFFER, 0, stride * RING_SIZE, flags));
+        }
+        else
+#endif
+        {
+            glBufferData(GL_UNIFORM_BUFFER, sizeof(T), NULL, GL_DYNAMIC_DRAW);
+            glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+    ~UniformBuffer()
+    {
+        for (GLsync& fence : fences)
+            if (fence)
+                glDeleteSync(fence);
+        if (mapped)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, ID);
+            glUnmapBuffer(GL_UNIFORM_BUFFER);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &ID);
+    }
+
+    UniformBuffer(const UniformBuffer&) = delete;
+    UniformBuffer& operator=(const UniformBuffer&) = delete;
+
+    // upload the block; call once per frame (FrameUniforms) or whenever the scene changes (SceneUniforms)
+    void Update(const T& data)
+    {
+        if (!persistent)
+        {
+            glBindBuffer(GL_UNIFORM_BUFFER, ID);
+            glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+            glBindBuffer(GL_UNIFORM_BUFFER, 0);
+            return;
+        }
+
+        // everything drawn since the previous Update read the current region
+        if (updates > 0)
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        current = (current + 1) % RING_SIZE;
+        if (fences[current])
+        {
+            glClientWaitSync(fences[current], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            glDeleteSync(fences[current]);
+            fences[current] = 0;
+        }
+        std::memcpy(mapped + current * stride, &data, sizeof(T));
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, ID, current * stride, sizeof(T));
+        updates++;
+    }
+
+    GLuint Binding() const { return binding; }
+
+private:
+    static const unsigned int RING_SIZE = 3;
+
+    GLuint binding;
+    bool persistent;
+    char* mapped = nullptr;
+    size_t stride = 0;
+    unsigned int current = 0;
+    unsigned long long updates = 0;
+    GLsync fences[RING_SIZE] = {};
+};
+#endif
@@ -0,0 +1,67 @@
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// a resolved uniform location, see Shader::location(); a struct rather than a bare GLint so an integer passed to a
+// setter can't quietly pick the handle overload
+struct UniformHandle
+{
+    GLint value;
+};
+
+// non-owning view of a uniform name; built from a literal or a std::string without copying the characters.
+// the name must stay NUL-terminated since it may be handed to glGetUniformLocation
+struct UniformName
+{
+    const char* data;
+    size_t length;
+
+    UniformName(const char* name) : data(name), length(std::strlen(name)) {}
+    UniformName(const std::string& name) : data(name.c_str()), length(name.size()) {}
+};
+
+// uniform name -> location; the map is keyed by views into names it owns, so a UniformName can be looked up
+// without building a std::string
+class UniformLocationCache
+{
+public:
+    bool find(UniformName name, GLint& location) const
+    {
+        auto it = locations.find(std::string_view(name.data, name.length));
+        if (it == locations.end())
+            return false;
+        location = it->second;
+        return true;
+    }
+    void insert(UniformName name, GLint location)
+    {
+        auto it = locations.find(std::string_view(name.data, name.length));
+        if (it != locations.end())
+        {
+            it->second = location;
+            return;
+        }
+        // deque elements never move, so the views stay valid as names are added
+        names.emplace_back(name.data, name.length);
+        locations.emplace(names.back(), location);
+    }
+    void clear()
+    {
+        locations.clear();
+        names.clear();
+    }
+
+private:
+    std::unordered_map<std::string_view, GLint> locations;
+    std::deque<std::string> names;
+};
+
+#endif
@@ -0,0 +1,576 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+// Wavefront OBJ loader shared by ZMesh (post-mid/Lab9) and the TestGraphics software renderer.
+//
+// The file is mapped (or, on Windows, read in one go) and parsed in place by a hand-written number scanner: no line
+// buffers, no streams, no per-line allocations. Large files are split into newline-aligned chunks that are parsed on
+// several threads; chunks record negative (relative) indices against their own counts and are stitched together
+// afterwards. Faces may have any number of corners (fanned into triangles), any of the v, v/vt, v//vn, v/vt/vn forms,
+// and positive or negative indices. Corners are deduplicated on their (v, vt, vn) triple with an open-addressing hash
+// table, and the result is indexed SoA buffers.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Files smaller than this are parsed on the calling thread only
+#define OBJ_PARALLEL_THRESHOLD (1 << 20)
+
+// Indexed mesh with one array per vertex component
+struct ObjMesh
+{
+    std::vector<float> x, y, z;    // positions
+    std::vector<float> u, v;       // texture coordinates; 0 for corners the file gives none
+    std::vector<float> nx, ny, nz; // normals; 0 for corners the file gives none
+    std::vector<uint32_t> indices; // 3 per triangle
+    bool hasTexCoords = false;     // the file has vt lines
+    bool hasNormals = false;       // the file has vn lines
+    std::string error;             // why loadObj failed
+
+    size_t vertexCount() const { return x.size(); }
+    size_t triangleCount() const { return indices.size() / 3; }
+};
+
+struct ObjLoadOptions
+{
+    unsigned int threads = 0; // 0: one per hardware thread
+    size_t parallelThreshold = OBJ_PARALLEL_THRESHOLD;
+};
+
+struct ObjLoadStats
+{
+    size_t bytes = 0;
+    unsigned int threads = 0;
+    size_t positions = 0, texCoords = 0, normals = 0;
+    size_t faces = 0;
+    double parseMs = 0.0;   // reading the file and scanning the text
+    double resolveMs = 0.0; // stitching chunks and checking indices
+    double dedupMs = 0.0;   // merging corners into vertices
+    double totalMs = 0.0;
+
+    double megabytesPerSecond() const { return totalMs > 0.0 ? bytes / (totalMs * 1000.0) : 0.0; }
+};
+
+namespace obj_detail
+{
+    const int32_t MISSING = INT32_MIN;
+
+    // A face corner. Each index is 0-based; a set bit in relative means the index is relative to the start of the
+    // chunk's own elements (it came from a negative index) and becomes absolute once the chunk's base is known.
+    struct Corner
+    {
+        int32_t index[3]; // v, vt, vn
+        uint32_t relative;
+    };
+
+    struct Chunk
+    {
+        const char *begin, *end;
+        std::vector<float> positions, texCoords, normals; // 3, 2 and 3 floats each
+        std::vector<Corner> corners;                      // 3 per triangle
+        size_t faces = 0;
+        size_t base[3] = {0, 0, 0};
+        bool badIndex = false;
+    };
+
+    // File contents, mapped where the platform allows it. On Windows the file is read into one buffer instead, since
+    // <windows.h> clashes with raylib's names (CloseWindow, DrawText, Rectangle...).
+    struct FileView
+    {
+        const char *data = nullptr;
+        size_t size = 0;
+#ifdef _WIN32
+        std::vector<char> buffer;
+#else
+        void *mapping = nullptr;
+#endif
+
+        bool open(const char *fileName)
+        {
+#ifdef _WIN32
+            FILE *file = nullptr;
+            if (fopen_s(&file, fileName, "rb") != 0 || !file)
+                return false;
+            fseek(file, 0, SEEK_END);
+            long length = ftell(file);
+            fseek(file, 0, SEEK_SET);
+            if (length < 0)
+            {
+                fclose(file);
+                return false;
+            }
+            buffer.resize((size_t)length);
+            size = fread(buffer.data(), 1, buffer.size(), file);
+            fclose(file);
+            data = buffer.data();
+            return size == buffer.size();
+#else
+            int fd = ::open(fileName, O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat info;
+            if (fstat(fd, &info) != 0)
+            {
+                ::close(fd);
+                return false;
+            }
+            size = (size_t)info.st_size;
+            if (size > 0)
+            {
+                mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED)
+                {
+                    mapping = nullptr;
+                    ::close(fd);
+                    return false;
+                }
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                data = (const char *)mapping;
+            }
+            ::close(fd);
+            return true;
+#endif
+        }
+
+        ~FileView()
+        {
+#ifndef _WIN32
+            if (mapping)
+                munmap(mapping, size);
+#endif
+        }
+    };
+
+    inline bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    inline bool isDigit(char c) { return (unsigned char)(c - '0') < 10; }
+
+    inline const char *skipSpaces(const char *p, const char *end)
+    {
+        while (p < end && isSpace(*p))
+            p++;
+        return p;
+    }
+
+    // Scans a decimal float ([sign] digits [. digits] [e [sign] digits]); returns the character after it, or nullptr
+    // (leaving out untouched) if there is no number at p
+    inline const char *parseFloat(const char *p, const char *end, float &out)
+    {
+        static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+        p = skipSpaces(p, end);
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+
+        uint64_t mantissa = 0;
+        int digits = 0, exponent = 0;
+        bool any = false;
+        for (; p < end && isDigit(*p); p++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+            }
+            else
+                exponent++;
+        }
+        if (p < end && *p == '.')
+        {
+            for (p++; p < end && isDigit(*p); p++, any = true)
+            {
+                if (digits < 19)
+                {
+                    mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                    digits += mantissa != 0;
+                    exponent--;
+                }
+            }
+        }
+        if (!any)
+            return nullptr;
+
+        if (p < end && (*p == 'e' || *p == 'E'))
+        {
+            const char *q = p + 1;
+            bool negativeExponent = false;
+            if (q < end && (*q == '-' || *q == '+'))
+                negativeExponent = *q++ == '-';
+            if (q < end && isDigit(*q))
+            {
+                int e = 0;
+                for (; q < end && isDigit(*q); q++)
+                    e = std::min(e * 10 + (*q - '0'), 100000);
+                exponent += negativeExponent ? -e : e;
+                p = q;
+            }
+        }
+
+        double value = (double)mantissa;
+        if (exponent < 0 && exponent >= -22)
+            value /= powers[-exponent];
+        else if (exponent > 0 && exponent <= 22)
+            value *= powers[exponent];
+        else if (exponent != 0)
+            value *= std::pow(10.0, exponent);
+        out = (float)(negative ? -value : value);
+        return p;
+    }
+
+    // Scans a decimal integer with an optional sign; nullptr if there is none at p
+    inline const char *parseInt(const char *p, const char *end, int64_t &out)
+    {
+        bool negative = false;
+        if (p < end && (*p == '-' || *p == '+'))
+            negative = *p++ == '-';
+        if (p >= end || !isDigit(*p))
+            return nullptr;
+        // stops accumulating once past INT32_MAX (out of range anyway) but still skips the remaining digits
+        int64_t value = 0;
+        for (; p < end && isDigit(*p); p++)
+        {
+            if (value <= INT32_MAX)
+                value = value * 10 + (*p - '0');
+        }
+        if (value > INT32_MAX)
+            value = INT32_MAX;
+        out = negative ? -value : value;
+        return p;
+    }
+
+    // Reads up to count floats into out, zero-filling any the line doesn't have
+    inline void parseFloats(const char *p, const char *end, float *out, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            out[i] = 0.0f;
+            if (p)
+                p = parseFloat(p, end, out[i]);
+        }
+    }
+
+    // Turns a 1-based OBJ index (negative: counted back from the last element so far) into a chunk corner index
+    inline void resolveIndex(int64_t raw, size_t localCount, int attribute, Corner &corner, Chunk &chunk)
+    {
+        if (raw > 0)
+            corner.index[attribute] = (int32_t)(raw - 1);
+        else if (raw < 0)
+        {
+            // may point before this chunk's first element; it is fixed up against the chunk base later
+            corner.index[attribute] = (int32_t)((int64_t)localCount + raw);
+            corner.relative |= 1u << attribute;
+        }
+        else
+            chunk.badIndex = true;
+    }
+
+    // Parses one face line into fanned triangle corners
+    inline void parseFace(const char *p, const char *end, Chunk &chunk)
+    {
+        const size_t counts[3] = {chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3};
+        Corner first = {}, previous = {};
+        int cornerCount = 0;
+        for (;;)
+        {
+            p = skipSpaces(p, end);
+            int64_t raw;
+            const char *next = parseInt(p, end, raw);
+            if (!next)
+                break;
+            p = next;
+
+            Corner corner = {{MISSING, MISSING, MISSING}, 0};
+            resolveIndex(raw, counts[0], 0, corner, chunk);
+            for (int attribute = 1; attribute < 3 && p < end && *p == '/'; attribute++)
+            {
+                p++;
+                if ((next = parseInt(p, end, raw)))
+                {
+                    resolveIndex(raw, counts[attribute], attribute, corner, chunk);
+                    p = next;
+                }
+            }
+            // skip whatever else is glued to the corner
+            while (p < end && !isSpace(*p))
+                p++;
+
+            if (cornerCount == 0)
+                first = corner;
+            else if (cornerCount >= 2)
+            {
+                chunk.corners.push_back(first);
+                chunk.corners.push_back(previous);
+                chunk.corners.push_back(corner);
+            }
+            previous = corner;
+            cornerCount++;
+        }
+        if (cornerCount >= 3)
+            chunk.faces++;
+    }
+
+    inline void parseChunk(Chunk &chunk)
+    {
+        const char *p = chunk.begin;
+        const char *end = chunk.end;
+        while (p < end)
+        {
+            const char *lineEnd = (const char *)memchr(p, '\n', (size_t)(end - p));
+            if (!lineEnd)
+                lineEnd = end;
+            p = skipSpaces(p, lineEnd);
+
+            if (lineEnd - p >= 2 && p[0] == 'v')
+            {
+                float values[3];
+                if (isSpace(p[1]))
+                {
+                    parseFloats(p + 2, lineEnd, values, 3);
+                    chunk.positions.insert(chunk.positions.end(), values, values + 3);
+                }
+                else if (p[1] == 't' && lineEnd - p >= 3 && isSpace(p[2]))
+                {
+                    parseFloats(p + 3, lineEnd, values, 2);
+                    chunk.texCoords.insert(chunk.texCoords.end(), values, values + 2);
+                }
+                else if (p[1] == 'n' && lineEnd - p >= 3 && isSpace(p[2]))
+                {
+                    parseFloats(p + 3, lineEnd, values, 3);
+                    chunk.normals.insert(chunk.normals.end(), values, values + 3);
+                }
+            }
+            else if (lineEnd - p >= 2 && p[0] == 'f' && isSpace(p[1]))
+                parseFace(p + 2, lineEnd, chunk);
+
+            p = lineEnd + 1;
+        }
+    }
+
+    inline uint64_t cornerHash(const int32_t *index)
+    {
+        uint64_t h = (uint32_t)index[0] * 0x9E3779B97F4A7C15ull;
+        h ^= ((uint32_t)index[1] + 0x632BE59BD9B4E019ull) * 0xC2B2AE3D27D4EB4Full;
+        h ^= ((uint32_t)index[2] + 0x85EBCA77C2B2AE63ull) * 0x165667B19E3779F9ull;
+        return h ^ (h >> 29);
+    }
+
+    inline double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+// Loads fileName into out. Returns false, with out.error set, if the file can't be read or a face refers to an
+// element that doesn't exist.
+inline bool loadObj(const char *fileName, ObjMesh &out, const ObjLoadOptions &options = ObjLoadOptions(),
+                    ObjLoadStats *stats = nullptr)
+{
+    using namespace obj_detail;
+    const auto start = std::chrono::steady_clock::now();
+    out = ObjMesh();
+    ObjLoadStats localStats;
+    ObjLoadStats &st = stats ? *stats : localStats;
+    st = ObjLoadStats();
+
+    FileView file;
+    if (!file.open(fileName))
+    {
+        out.error = std::string("cannot open ") + fileName;
+        return false;
+    }
+    st.bytes = file.size;
+
+    // Split into newline-aligned chunks and parse them in parallel
+    unsigned int threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    if (file.size < options.parallelThreshold)
+        threads = 1;
+    std::vector<Chunk> chunks(threads);
+    const char *begin = file.data;
+    const char *end = file.data + file.size;
+    for (unsigned int i = 0; i < threads; i++)
+    {
+        const char *chunkEnd = i + 1 == threads ? end : file.data + file.size / threads * (i + 1);
+        if (chunkEnd < begin)
+            chunkEnd = begin;
+        if (chunkEnd < end)
+        {
+            const char *newline = (const char *)memchr(chunkEnd, '\n', (size_t)(end - chunkEnd));
+            chunkEnd = newline ? newline + 1 : end;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = chunkEnd;
+        begin = chunkEnd;
+    }
+    if (threads == 1)
+        parseChunk(chunks[0]);
+    else
+    {
+        std::vector<std::thread> workers;
+        for (unsigned int i = 1; i < threads; i++)
+            workers.emplace_back([&chunks, i] { parseChunk(chunks[i]); });
+        parseChunk(chunks[0]);
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+    st.threads = threads;
+    st.parseMs = millisecondsSince(start);
+
+    // Stitch: each chunk's elements start where the previous chunks' end
+    const auto resolveStart = std::chrono::steady_clock::now();
+    std::vector<float> positions, texCoords, normals;
+    size_t totals[3] = {0, 0, 0};
+    size_t cornerCount = 0;
+    for (Chunk &chunk : chunks)
+    {
+        const size_t counts[3] = {chunk.positions.size() / 3, chunk.texCoords.size() / 2, chunk.normals.size() / 3};
+        for (int a = 0; a < 3; a++)
+        {
+            chunk.base[a] = totals[a];
+            totals[a] += counts[a];
+        }
+        cornerCount += chunk.corners.size();
+        st.faces += chunk.faces;
+    }
+    positions.reserve(totals[0] * 3);
+    texCoords.reserve(totals[1] * 2);
+    normals.reserve(totals[2] * 3);
+    std::vector<Corner> corners;
+    corners.reserve(cornerCount);
+    bool badIndex = false;
+    for (Chunk &chunk : chunks)
+    {
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        badIndex |= chunk.badIndex;
+        for (Corner corner : chunk.corners)
+        {
+            for (int a = 0; a < 3; a++)
+            {
+                if (corner.index[a] == MISSING)
+                    continue;
+                int64_t index = corner.index[a];
+                if (corner.relative & (1u << a))
+                    index += (int64_t)chunk.base[a];
+                if (index < 0 || index >= (int64_t)totals[a])
+                    badIndex = true;
+                corner.index[a] = (int32_t)index;
+            }
+            // a corner without a position can't be drawn
+            badIndex |= corner.index[0] == MISSING;
+            corners.push_back(corner);
+        }
+        chunk = Chunk(); // release the chunk's buffers early
+    }
+    st.positions = totals[0];
+    st.texCoords = totals[1];
+    st.normals = totals[2];
+    st.resolveMs = millisecondsSince(resolveStart);
+    if (badIndex)
+    {
+        out.error = "face index out of range";
+        return false;
+    }
+
+    // Deduplicate (v, vt, vn) triples into output vertices
+    const auto dedupStart = std::chrono::steady_clock::now();
+    out.hasTexCoords = totals[1] > 0;
+    out.hasNormals = totals[2] > 0;
+    // Most meshes have about as many vertices as their largest attribute list, so the table starts at twice that and
+    // doubles whenever it gets half full
+    struct Slot
+    {
+        int32_t index[3];
+        uint32_t vertex; // UINT32_MAX: empty
+    };
+    size_t capacity = 16;
+    while (capacity < std::max({totals[0], totals[1], totals[2]}) * 2)
+        capacity <<= 1;
+    std::vector<Slot> table(capacity, Slot{{0, 0, 0}, UINT32_MAX});
+    size_t mask = capacity - 1;
+    out.indices.resize(corners.size());
+    std::vector<uint32_t> unique; // corner that introduced each vertex
+    unique.reserve(capacity / 2);
+    for (size_t c = 0; c < corners.size(); c++)
+    {
+        const int32_t *key = corners[c].index;
+        for (size_t slot = cornerHash(key) & mask;; slot = (slot + 1) & mask)
+        {
+            Slot &s = table[slot];
+            if (s.vertex == UINT32_MAX)
+            {
+                std::copy(key, key + 3, s.index);
+                s.vertex = (uint32_t)unique.size();
+                unique.push_back((uint32_t)c);
+                out.indices[c] = s.vertex;
+                if (unique.size() * 2 > capacity)
+                {
+                    std::vector<Slot> old(capacity * 2, Slot{{0, 0, 0}, UINT32_MAX});
+                    old.swap(table);
+                    capacity *= 2;
+                    mask = capacity - 1;
+                    for (const Slot &moved : old)
+                    {
+                        if (moved.vertex == UINT32_MAX)
+                            continue;
+                        size_t to = cornerHash(moved.index) & mask;
+                        while (table[to].vertex != UINT32_MAX)
+                            to = (to + 1) & mask;
+                        table[to] = moved;
+                    }
+                }
+                break;
+            }
+            if (s.index[0] == key[0] && s.index[1] == key[1] && s.index[2] == key[2])
+            {
+                out.indices[c] = s.vertex;
+                break;
+            }
+        }
+    }
+
+    const size_t vertexCount = unique.size();
+    out.x.resize(vertexCount); out.y.resize(vertexCount); out.z.resize(vertexCount);
+    out.u.resize(vertexCount); out.v.resize(vertexCount);
+    out.nx.resize(vertexCount); out.ny.resize(vertexCount); out.nz.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++)
+    {
+        const int32_t *key = corners[unique[i]].index;
+        const float *p = &positions[(size_t)key[0] * 3];
+        out.x[i] = p[0]; out.y[i] = p[1]; out.z[i] = p[2];
+        if (key[1] != MISSING)
+        {
+            const float *t = &texCoords[(size_t)key[1] * 2];
+            out.u[i] = t[0]; out.v[i] = t[1];
+        }
+        else
+            out.u[i] = out.v[i] = 0.0f;
+        if (key[2] != MISSING)
+        {
+            const float *n = &normals[(size_t)key[2] * 3];
+            out.nx[i] = n[0]; out.ny[i] = n[1]; out.nz[i] = n[2];
+        }
+        else
+            out.nx[i] = out.ny[i] = out.nz[i] = 0.0f;
+    }
+    st.dedupMs = millisecondsSince(dedupStart);
+    st.totalMs = millisecondsSince(start);
+    return true;
+}
+
+#endif
@@ -3,10 +3,13 @@
 
 ZModel car;
 
+// Three cars drawn from the one car model; the keys move the selected one
+std::vector<ZInstance> cars(3);
+int selectedCar = 1;
+
 glm::vec3 carTranslation(0.0f, 0.0f, 0.0f);
 float carRotationAngle = 0.0f;
 glm::vec3 carRotationAxis(0.0f, 1.0f, 0.0f);
-int carTextureIndex = 0;
 
 void init()
 {
@@ -16,6 +19,12 @@ void init()
 
     car.loadModel("car", "./");
     car.loadModelTexture("./car_another_diffuse.png");
+
+    for (int i = 0; i < (int)cars.size(); i++)
+    {
+        cars[i].transform.translate(glm::vec3(-0.65f + 0.65f * i, 0.0f, 0.0f));
+        cars[i].textureIndex = i % 2;
+    }
 }
 
 void display()
@@ -29,7 +38,7 @@ void display()
     gluOrtho2D(-1.0, 1.0, -1.0, 1.0);
     glMatrixMode(GL_MODELVIEW);
 
-    car.drawModel(carTextureIndex);
+    car.drawInstances(cars);
 
     glutSwapBuffers();
 }
@@ -39,7 +48,7 @@ void reshape(int w, int h)
     glViewport(0, 0, w, h);
 }
 
-// Translate the model using the keyboard WASDQE
+// Translate the selected car using the keyboard WASDQE, pick the next car with N
 void keyboardFunction(unsigned char key, int x, int y)
 {
     switch (key)
@@ -75,24 +84,27 @@ void keyboardFunction(unsigned char key, int x, int y)
         carRotationAxis = glm::vec3(0.0f, 0.0f, 1.0f);
         break;
     case '1':
-        carTextureIndex = 0;
+        cars[selectedCar].textureIndex = 0;
         break;
     case '2':
-        carTextureIndex = 1;
+        cars[selectedCar].textureIndex = 1;
+        break;
+    case 'n':
+        selectedCar = (selectedCar + 1) % cars.size();
         break;
     default:
         break;
     }
     // Update the model with the new translation and rotation
-    car.translateModel(carTranslation);
-    car.rotateModel(carRotationAngle, carRotationAxis);
+    cars[selectedCar].transform.translate(carTranslation);
+    cars[selectedCar].transform.rotate(carRotationAngle, carRotationAxis);
     // reset the car translation and rotation
     carTranslation = glm::vec3(0.0f, 0.0f, 0.0f);
     carRotationAngle = 0.0f;
     glutPostRedisplay();
 }
 
-// Rotate the model using the mouse
+// Rotate the selected car using the mouse
 void mouseFunction(int button, int state, int x, int y)
 {
     if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN)
@@ -103,8 +115,8 @@ void mouseFunction(int button, int state, int x, int y)
     }
 
     // Update the model with the new translation and rotation
-    car.translateModel(carTranslation);
-    car.rotateModel(carRotationAngle, carRotationAxis);
+    cars[selectedCar].transform.translate(carTranslation);
+    cars[selectedCar].transform.rotate(carRotationAngle, carRotationAxis);
     // reset the car translation and rotation
     carTranslation = glm::vec3(0.0f, 0.0f, 0.0f);
     carRotationAngle = 0.0f;
@@ -2,11 +2,18 @@
 #define ZYNMESH_H
 
 #include "./helpers.h"
+#include "./obj_loader.h"
 #include <glm/glm.hpp>
 #include <vector>
+#include <cstddef>
 #include <cstdio>
 #include <string>
-#include <glm/gtc/matrix_transform.hpp> // For glm::rotate
+#include <glm/gtc/matrix_transform.hpp> // For glm::translate, glm::scale
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#ifdef FREEGLUT
+#include <GL/freeglut_ext.h> // For glutGetProcAddress
+#endif
 
 struct Triangle
 {
@@ -18,76 +25,152 @@ struct Triangle
 struct ZMesh
 {
     std::vector<Triangle> tris;
+    ObjMesh indexed; // the mesh as loadObj returned it: unique vertices and 3 indices per triangle
 
     bool loadFromObjectFile(const char *fileName)
     {
-        std::vector<glm::vec3> vertices;
-        std::vector<glm::vec2> texCoords;
-        std::vector<glm::vec3> normCoords;
-
-        FILE *file = fopen(fileName, "r");
-        if (!file)
+        if (!loadObj(fileName, indexed))
         {
-            printf("Failed to open file for reading\n");
+            printf("Failed to load %s: %s\n", fileName, indexed.error.c_str());
             return false;
         }
 
-        while (!feof(file))
+        // Expand the indexed mesh into triangles for drawing
+        tris.resize(indexed.triangleCount());
+        for (size_t i = 0; i < tris.size(); i++)
         {
-            char line[128];
-
-            // Clear the line buffer
-            for (int i = 0; i < sizeof(line); i++)
+            for (int k = 0; k < 3; k++)
             {
-                line[i] = '\0';
+                uint32_t index = indexed.indices[i * 3 + k];
+                tris[i].v[k] = glm::vec3(indexed.x[index], indexed.y[index], indexed.z[index]);
+                tris[i].t[k] = glm::vec2(indexed.u[index], indexed.v[index]);
+                tris[i].n[k] = glm::vec3(indexed.nx[index], indexed.ny[index], indexed.nz[index]);
             }
+        }
+        return true;
+    }
+};
+
+// Buffer object entry points (OpenGL 1.5). GL/gl.h only declares OpenGL 1.1 on Windows, so they are looked up at run
+// time through freeglut; without freeglut, or on an older context, ZModel draws from a display list instead.
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#endif
+#ifndef GL_STATIC_DRAW
+#define GL_STATIC_DRAW 0x88E4
+#endif
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+struct ZBufferApi
+{
+    typedef void(APIENTRY *GenBuffersProc)(GLsizei n, GLuint *buffers);
+    typedef void(APIENTRY *DeleteBuffersProc)(GLsizei n, const GLuint *buffers);
+    typedef void(APIENTRY *BindBufferProc)(GLenum target, GLuint buffer);
+    typedef void(APIENTRY *BufferDataProc)(GLenum target, ptrdiff_t size, const void *data, GLenum usage);
+
+    GenBuffersProc genBuffers = nullptr;
+    DeleteBuffersProc deleteBuffers = nullptr;
+    BindBufferProc bindBuffer = nullptr;
+    BufferDataProc bufferData = nullptr;
 
-            fgets(line, sizeof(line), file);
-            if (line[0] == 'v')
+    bool available() const { return genBuffers && deleteBuffers && bindBuffer && bufferData; }
+
+    // Looked up on first use, which must be with a current context
+    static const ZBufferApi &get()
+    {
+        static ZBufferApi api;
+        static bool loaded = false;
+        if (!loaded)
+        {
+            loaded = true;
+#ifdef FREEGLUT
+            const char *version = (const char *)glGetString(GL_VERSION);
+            int major = 0, minor = 0;
+            if (version && sscanf(version, "%d.%d", &major, &minor) == 2 && (major > 1 || (major == 1 && minor >= 5)))
             {
-                if (line[1] == 't')
-                {
-                    glm::vec2 texCoord;
-                    sscanf(line, "vt %f %f", &texCoord.x, &texCoord.y);
-                    texCoords.push_back(texCoord);
-                }
-                else if (line[1] == 'n')
-                {
-                    glm::vec3 normCoord;
-                    sscanf(line, "vn %f %f %f", &normCoord.x, &normCoord.y);
-                    normCoords.push_back(normCoord);
-                }
-                else
-                {
-                    glm::vec3 vertex;
-                    sscanf(line, "v %f %f %f", &vertex.x, &vertex.y, &vertex.z);
-                    vertices.push_back(vertex);
-                }
+                api.genBuffers = (GenBuffersProc)glutGetProcAddress("glGenBuffers");
+                api.deleteBuffers = (DeleteBuffersProc)glutGetProcAddress("glDeleteBuffers");
+                api.bindBuffer = (BindBufferProc)glutGetProcAddress("glBindBuffer");
+                api.bufferData = (BufferDataProc)glutGetProcAddress("glBufferData");
             }
-            else if (line[0] == 'f')
-            {
+#endif
+        }
+        return api;
+    }
+};
 
-                Triangle triangle;
-                int v1, vt1, vn1, v2, vt2, vn2, v3, vt3, vn3;
-                sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", &v1, &vt1, &vn1, &v2, &vt2, &vn2, &v3, &vt3, &vn3);
-
-                triangle.v[0] = vertices[v1 - 1];
-                triangle.v[1] = vertices[v2 - 1];
-                triangle.v[2] = vertices[v3 - 1];
-                // TODO Use texture resolution
-                triangle.t[0] = ((texCoords[vt1 - 1]));
-                triangle.t[1] = ((texCoords[vt2 - 1]));
-                triangle.t[2] = ((texCoords[vt3 - 1]));
-                triangle.n[0] = normCoords[vn1 - 1];
-                triangle.n[1] = normCoords[vn2 - 1];
-                triangle.n[2] = normCoords[vn3 - 1];
-
-                tris.push_back(triangle);
-            }
+// Vertex as stored in the vertex buffer, interleaved so one vertex is one contiguous 32-byte read
+struct ZVertex
+{
+    float position[3];
+    float normal[3];
+    float texCoord[2];
+};
+
+// Where one copy of a mesh sits: translation, rotation and scale, composed into a matrix that is only rebuilt after a
+// change. The edits work about the world origin, as the old vertex-rewriting ZModel functions did, so they stack the
+// same way.
+struct ZTransform
+{
+    void translate(const glm::vec3 &translation)
+    {
+        position += translation;
+        dirty = true;
+    }
+
+    // Rotates about the world origin, carrying the position around with it
+    void rotate(float angle, const glm::vec3 &axis)
+    {
+        glm::quat step = glm::angleAxis(glm::radians(angle), glm::normalize(axis));
+        rotation = glm::normalize(step * rotation);
+        position = step * position;
+        dirty = true;
+    }
+
+    // Scales about the world origin; for non-uniform factors the scale is applied along the model's own axes
+    void scale(const glm::vec3 &factors)
+    {
+        scaling *= factors;
+        position *= factors;
+        dirty = true;
+    }
+
+    void reset()
+    {
+        *this = ZTransform();
+    }
+
+    const glm::vec3 &getPosition() const { return position; }
+    const glm::quat &getRotation() const { return rotation; }
+    const glm::vec3 &getScale() const { return scaling; }
+
+    const glm::mat4 &matrix() const
+    {
+        if (dirty)
+        {
+            cached = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) *
+                     glm::scale(glm::mat4(1.0f), scaling);
+            dirty = false;
         }
-        fclose(file);
-        return true;
+        return cached;
     }
+
+private:
+    glm::vec3 position = glm::vec3(0.0f);
+    glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec3 scaling = glm::vec3(1.0f);
+    mutable glm::mat4 cached = glm::mat4(1.0f);
+    mutable bool dirty = false;
+};
+
+// One copy of a model in a batch: where it sits and which of the model's textures it wears
+struct ZInstance
+{
+    ZTransform transform;
+    int textureIndex = 0;
 };
 
 struct ZModel
@@ -95,6 +178,16 @@ struct ZModel
 
     ZMesh mesh;
 
+    // GPU copy of mesh.tris, built on the first draw after loading or changing the mesh
+    bool useBuffers = true; // false: always draw from a display list, as on contexts without buffer objects
+    GLuint vertexBuffer = 0, indexBuffer = 0;
+    GLsizei indexCount = 0;
+    GLuint displayList = 0;
+    bool meshDirty = true;
+
+    // Where drawModel puts the mesh; translateModel, rotateModel and scaleModel change this, not the vertices
+    ZTransform transform;
+
     // Texture variables
     std::vector<GLuint> textureIDs;
     int texWidth, texHeight, texChannels;
@@ -157,9 +250,82 @@ struct ZModel
         {
             return false;
         }
+        meshDirty = true;
         return true;
     }
 
+    // Builds the vertex and index buffers (or the display list) from mesh.tris. Corners that mesh.indexed merged share a
+    // vertex, which takes its data from the last of them; set meshDirty after editing mesh.tris by hand.
+    void uploadMesh()
+    {
+        releaseMesh();
+        meshDirty = false;
+
+        const ZBufferApi &gl = ZBufferApi::get();
+        if (!useBuffers || !gl.available())
+        {
+            displayList = glGenLists(1);
+            glNewList(displayList, GL_COMPILE);
+            glBegin(GL_TRIANGLES);
+            for (const auto &tri : mesh.tris)
+            {
+                for (int i = 0; i < 3; i++)
+                {
+                    glTexCoord2f(tri.t[i].x, tri.t[i].y);
+                    glNormal3f(tri.n[i].x, tri.n[i].y, tri.n[i].z);
+                    glVertex3f(tri.v[i].x, tri.v[i].y, tri.v[i].z);
+                }
+            }
+            glEnd();
+            glEndList();
+            return;
+        }
+
+        // Without a matching index list (a mesh filled in by hand) every corner gets its own vertex
+        const size_t cornerCount = mesh.tris.size() * 3;
+        const bool indexed = mesh.indexed.indices.size() == cornerCount;
+        std::vector<GLuint> indices(cornerCount);
+        std::vector<ZVertex> vertices(indexed ? mesh.indexed.vertexCount() : cornerCount);
+        for (size_t c = 0; c < cornerCount; c++)
+        {
+            const Triangle &tri = mesh.tris[c / 3];
+            const int k = (int)(c % 3);
+            indices[c] = indexed ? mesh.indexed.indices[c] : (GLuint)c;
+            vertices[indices[c]] = {{tri.v[k].x, tri.v[k].y, tri.v[k].z},
+                                    {tri.n[k].x, tri.n[k].y, tri.n[k].z},
+                                    {tri.t[k].x, tri.t[k].y}};
+        }
+
+        gl.genBuffers(1, &vertexBuffer);
+        gl.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl.bufferData(GL_ARRAY_BUFFER, (ptrdiff_t)(vertices.size() * sizeof(ZVertex)), vertices.data(), GL_STATIC_DRAW);
+        gl.bindBuffer(GL_ARRAY_BUFFER, 0);
+        gl.genBuffers(1, &indexBuffer);
+        gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        gl.bufferData(GL_ELEMENT_ARRAY_BUFFER, (ptrdiff_t)(indices.size() * sizeof(GLuint)), indices.data(), GL_STATIC_DRAW);
+        gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        indexCount = (GLsizei)indices.size();
+    }
+
+    // Frees the GPU copy of the mesh; the next draw builds it again
+    void releaseMesh()
+    {
+        if (vertexBuffer || indexBuffer)
+        {
+            const ZBufferApi &gl = ZBufferApi::get();
+            GLuint buffers[2] = {vertexBuffer, indexBuffer};
+            gl.deleteBuffers(2, buffers);
+            vertexBuffer = indexBuffer = 0;
+            indexCount = 0;
+        }
+        if (displayList)
+        {
+            glDeleteLists(displayList, 1);
+            displayList = 0;
+        }
+        meshDirty = true;
+    }
+
     void drawModel(int textureIndex = 0)
     {
         if (textureIndex < 0 || textureIndex >= textureIDs.size())
@@ -168,56 +334,106 @@ struct ZModel
             return;
         }
 
+        beginMesh();
         glBindTexture(GL_TEXTURE_2D, textureIDs[textureIndex]);
-        glBegin(GL_TRIANGLES);
+        glPushMatrix();
+        glMultMatrixf(glm::value_ptr(transform.matrix()));
+        drawMesh();
+        glPopMatrix();
+        glBindTexture(GL_TEXTURE_2D, 0);
+        endMesh();
+    }
 
-        for (const auto &tri : mesh.tris)
+    // Draws the mesh once per instance, all from the same vertex buffer (or display list): the arrays are set up once,
+    // then each instance only loads its matrix and, when it differs from the previous one, binds its texture.
+    // The model's own transform is not applied.
+    void drawInstances(const std::vector<ZInstance> &instances)
+    {
+        beginMesh();
+        int boundTexture = -1;
+        for (const ZInstance &instance : instances)
         {
-            for (int i = 0; i < 3; i++)
+            if (instance.textureIndex < 0 || instance.textureIndex >= (int)textureIDs.size())
             {
-                glTexCoord2f(tri.t[i].x, tri.t[i].y);
-                glNormal3f(tri.n[i].x, tri.n[i].y, tri.n[i].z);
-                glVertex3f(tri.v[i].x, tri.v[i].y, tri.v[i].z);
+                printf("Invalid texture index\n");
+                continue;
             }
+            if (instance.textureIndex != boundTexture)
+            {
+                glBindTexture(GL_TEXTURE_2D, textureIDs[instance.textureIndex]);
+                boundTexture = instance.textureIndex;
+            }
+            glPushMatrix();
+            glMultMatrixf(glm::value_ptr(instance.transform.matrix()));
+            drawMesh();
+            glPopMatrix();
         }
-
-        glEnd();
         glBindTexture(GL_TEXTURE_2D, 0);
+        endMesh();
     }
 
-    void translateModel(const glm::vec3 &translation)
+    // beginMesh sets up the arrays for drawMesh, building the buffers first if needed; endMesh puts the state back
+    void beginMesh()
     {
-        for (auto &tri : mesh.tris)
+        if (meshDirty)
         {
-            for (int i = 0; i < 3; i++)
-            {
-                tri.v[i] += translation;
-            }
+            uploadMesh();
         }
+        if (displayList)
+        {
+            return;
+        }
+
+        const ZBufferApi &gl = ZBufferApi::get();
+        gl.bindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+        gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glVertexPointer(3, GL_FLOAT, sizeof(ZVertex), (const void *)offsetof(ZVertex, position));
+        glNormalPointer(GL_FLOAT, sizeof(ZVertex), (const void *)offsetof(ZVertex, normal));
+        glTexCoordPointer(2, GL_FLOAT, sizeof(ZVertex), (const void *)offsetof(ZVertex, texCoord));
     }
 
-    void rotateModel(float angle, const glm::vec3 &axis)
+    void drawMesh()
     {
-        glm::mat4 rotationMatrix = glm::rotate(glm::mat4(1.0f), glm::radians(angle), axis);
-        for (auto &tri : mesh.tris)
+        if (displayList)
         {
-            for (int i = 0; i < 3; i++)
-            {
-                glm::vec4 rotatedVertex = rotationMatrix * glm::vec4(tri.v[i], 1.0f);
-                tri.v[i] = glm::vec3(rotatedVertex);
-            }
+            glCallList(displayList);
+        }
+        else
+        {
+            glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, nullptr);
         }
     }
 
-    void scaleModel(const glm::vec3 &scaleFactors)
+    void endMesh()
     {
-        for (auto &tri : mesh.tris)
+        if (displayList)
         {
-            for (int i = 0; i < 3; i++)
-            {
-                tri.v[i] *= scaleFactors;
-            }
+            return;
         }
+
+        const ZBufferApi &gl = ZBufferApi::get();
+        glPopClientAttrib();
+        gl.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        gl.bindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void translateModel(const glm::vec3 &translation)
+    {
+        transform.translate(translation);
+    }
+
+    void rotateModel(float angle, const glm::vec3 &axis)
+    {
+        transform.rotate(angle, axis);
+    }
+
+    void scaleModel(const glm::vec3 &scaleFactors)
+    {
+        transform.scale(scaleFactors);
     }
 
     void generateProceduralTexture(int width, int height)